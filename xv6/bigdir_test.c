@@ -0,0 +1,78 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define DIRNAME "bigdir"
+#define NENTRIES 5000
+
+char name[16];
+
+void mkname(int i)
+{
+  strcpy(name, DIRNAME "/f0000");
+  name[8] = '0' + i / 1000;
+  name[9] = '0' + (i / 100) % 10;
+  name[10] = '0' + (i / 10) % 10;
+  name[11] = '0' + i % 10;
+}
+
+int main(int argc, char *argv[])
+{
+  struct stat st;
+  int i, fd, start, lap;
+
+  if (mkdir(DIRNAME) < 0)
+  {
+    printf(2, "bigdir_test: mkdir %s failed\n", DIRNAME);
+    exit();
+  }
+
+  // With a hashed directory each create touches one hash
+  // chain, so the time per 1000 creates stays flat.
+  start = lap = uptime();
+  for (i = 0; i < NENTRIES; i++)
+  {
+    mkname(i);
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    {
+      printf(2, "bigdir_test: cannot create %s\n", name);
+      exit();
+    }
+    close(fd);
+    if ((i + 1) % 1000 == 0)
+    {
+      printf(1, "creates %d-%d: %d ticks\n", i - 999, i, uptime() - lap);
+      lap = uptime();
+    }
+  }
+  printf(1, "created %d entries in %d ticks\n", NENTRIES, uptime() - start);
+
+  start = uptime();
+  for (i = 0; i < NENTRIES; i++)
+  {
+    mkname(i);
+    if (stat(name, &st) < 0)
+    {
+      printf(2, "bigdir_test: stat %s failed\n", name);
+      exit();
+    }
+  }
+  printf(1, "looked up %d entries in %d ticks\n", NENTRIES, uptime() - start);
+
+  for (i = 0; i < NENTRIES; i++)
+  {
+    mkname(i);
+    if (unlink(name) < 0)
+    {
+      printf(2, "bigdir_test: unlink %s failed\n", name);
+      exit();
+    }
+  }
+  if (unlink(DIRNAME) < 0)
+  {
+    printf(2, "bigdir_test: unlink %s failed\n", DIRNAME);
+    exit();
+  }
+  exit();
+}
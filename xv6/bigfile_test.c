@@ -0,0 +1,82 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define FILENAME "bigfile.tmp"
+#define NBLOCKS 4096  // 2 MB, well into the double-indirect range
+#define NREADS 1000
+
+char buf[512];
+
+// Write NBLOCKS blocks, each tagged with its block number,
+// and return the ticks taken.
+int write_file(void)
+{
+  int fd, i, start;
+
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+  {
+    printf(2, "bigfile_test: cannot create %s\n", FILENAME);
+    exit();
+  }
+  start = uptime();
+  for (i = 0; i < NBLOCKS; i++)
+  {
+    memset(buf, 0, sizeof(buf));
+    *(int *)buf = i;
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+    {
+      printf(2, "bigfile_test: write of block %d failed\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  return uptime() - start;
+}
+
+// Read NREADS pseudo-random blocks through lseek, checking
+// each tag, and return the ticks taken.
+int random_reads(void)
+{
+  int fd, i, bn, start;
+  uint seed;
+
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+  {
+    printf(2, "bigfile_test: cannot open %s\n", FILENAME);
+    exit();
+  }
+  seed = 12345;
+  start = uptime();
+  for (i = 0; i < NREADS; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    bn = (seed >> 8) % NBLOCKS;
+    if (lseek(fd, bn * sizeof(buf), SEEK_SET) != bn * sizeof(buf) ||
+        read(fd, buf, sizeof(buf)) != sizeof(buf) || *(int *)buf != bn)
+    {
+      printf(2, "bigfile_test: bad read of block %d\n", bn);
+      exit();
+    }
+  }
+  close(fd);
+  return uptime() - start;
+}
+
+int main(int argc, char *argv[])
+{
+  int ticks;
+
+  ticks = write_file();
+  printf(1, "sequential write: %d KB in %d ticks\n", NBLOCKS / 2, ticks);
+  ticks = random_reads();
+  printf(1, "random read: %d blocks in %d ticks\n", NREADS, ticks);
+
+  if (unlink(FILENAME) < 0)
+  {
+    printf(2, "bigfile_test: unlink failed\n");
+    exit();
+  }
+  exit();
+}
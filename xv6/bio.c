@@ -12,11 +12,18 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To read several blocks with their disk requests in flight
+//     at the same time, call breadv; bwritev does the same for
+//     writes of locked buffers.
+// * To start reading a block that will be needed soon, call
+//     bprefetch.  It does not wait and returns no buffer.
 //
 // The implementation uses two state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+// * B_ASYNC: a bprefetch read is in flight; the buffer is
+//     released by biodone when the disk finishes it.
 
 #include "types.h"
 #include "defs.h"
@@ -35,6 +42,9 @@ struct {
   struct buf head;
 } bcache;
 
+// How many disk requests breadv/bwritev keep in flight at once.
+static int iodepth = NIODEPTH;
+
 void
 binit(void)
 {
@@ -92,6 +102,44 @@ bget(uint dev, uint blockno)
   panic("bget: no buffers");
 }
 
+// Like bget, but never sleeps: returns 0 if the buffer for the
+// block is held by someone else or no buffer is free.  Used for
+// all but the first buffer of a batch, so that a caller never
+// waits for a buffer while holding others.
+static struct buf*
+bgettry(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      if(b->refcnt != 0)
+        break;
+      b->refcnt = 1;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);  // free, so does not sleep
+      return b;
+    }
+  }
+  if(b == &bcache.head){
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+        b->dev = dev;
+        b->blockno = blockno;
+        b->flags = 0;
+        b->refcnt = 1;
+        release(&bcache.lock);
+        acquiresleep(&b->lock);
+        return b;
+      }
+    }
+  }
+  release(&bcache.lock);
+  return 0;
+}
+
 // Return a locked buf with the contents of the indicated block.
 struct buf*
 bread(uint dev, uint blockno)
@@ -105,6 +153,115 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Read up to n blocks into bps[], with up to iodepth of the
+// disk requests outstanding at once.  Only the first block may
+// wait for its buffer; the batch stops early at a block whose
+// buffer is busy.  Returns the number of locked bufs in bps[],
+// which is always at least 1.
+int
+breadv(uint dev, uint *blocknos, int n, struct buf **bps)
+{
+  int i, k;
+  uint submitted;
+
+  if(n > iodepth)
+    n = iodepth;
+  bps[0] = bget(dev, blocknos[0]);
+  for(k = 1; k < n; k++)
+    if((bps[k] = bgettry(dev, blocknos[k])) == 0)
+      break;
+
+  submitted = 0;
+  for(i = 0; i < k; i++){
+    if((bps[i]->flags & B_VALID) == 0){
+      idesubmit(bps[i]);
+      submitted |= 1 << i;
+    }
+  }
+  for(i = 0; i < k; i++)
+    if(submitted & (1 << i))
+      idewaitrw(bps[i]);
+  return k;
+}
+
+// Write the contents of n locked bufs to disk, keeping up to
+// iodepth requests in flight at once.
+void
+bwritev(struct buf **bps, int n)
+{
+  int i, j, k;
+
+  for(i = 0; i < n; i += k){
+    k = n - i;
+    if(k > iodepth)
+      k = iodepth;
+    for(j = i; j < i + k; j++){
+      if(!holdingsleep(&bps[j]->lock))
+        panic("bwritev");
+      bps[j]->flags |= B_DIRTY;
+      idesubmit(bps[j]);
+    }
+    for(j = i; j < i + k; j++)
+      idewaitrw(bps[j]);
+  }
+}
+
+// Start reading a block into the cache without waiting for it.
+// Does nothing if the block is cached, its buffer is busy, or
+// no buffer is free.
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bgettry(dev, blockno)) == 0)
+    return;
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  b->flags |= B_ASYNC;
+  idesubmit(b);
+}
+
+// Called by the disk driver, possibly from an interrupt, when
+// a B_ASYNC read finishes.  Releases the prefetching process's
+// hold on the buffer, like brelse.
+void
+biodone(struct buf *b)
+{
+  b->flags &= ~B_ASYNC;
+  releasesleep(&b->lock);
+
+  acquire(&bcache.lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->next = bcache.head.next;
+    b->prev = &bcache.head;
+    bcache.head.next->prev = b;
+    bcache.head.next = b;
+  }
+  release(&bcache.lock);
+}
+
+// Set the number of disk requests a batch keeps in flight.
+// Returns the old depth.
+int
+setiodepth(int depth)
+{
+  int old;
+
+  if(depth < 1)
+    depth = 1;
+  if(depth > NIODEPTH)
+    depth = NIODEPTH;
+  old = iodepth;
+  iodepth = depth;
+  return old;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
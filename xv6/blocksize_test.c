@@ -0,0 +1,98 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define FILENAME "blocksize.tmp"
+#define DIRNAME "bsdir"
+#define FILESIZE (1024 * 1024)
+#define NFILES 100
+
+char buf[8192];
+
+// Write FILESIZE bytes in 8 KB writes and read them back, printing
+// the ticks taken by each half.
+void sequential(void)
+{
+  int fd, i, start;
+
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+  {
+    printf(2, "blocksize_test: cannot create %s\n", FILENAME);
+    exit();
+  }
+  start = uptime();
+  for (i = 0; i < FILESIZE / sizeof(buf); i++)
+  {
+    memset(buf, i, sizeof(buf));
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+    {
+      printf(2, "blocksize_test: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  printf(1, "sequential write: %d KB in %d ticks\n", FILESIZE / 1024, uptime() - start);
+
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+  {
+    printf(2, "blocksize_test: cannot open %s\n", FILENAME);
+    exit();
+  }
+  start = uptime();
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+  printf(1, "sequential read: %d KB in %d ticks\n", FILESIZE / 1024, uptime() - start);
+  unlink(FILENAME);
+}
+
+// Create, stat and unlink NFILES small files in one directory,
+// printing the ticks taken.
+void metadata(void)
+{
+  char name[16];
+  struct stat st;
+  int fd, i, start;
+
+  if (mkdir(DIRNAME) < 0)
+  {
+    printf(2, "blocksize_test: mkdir %s failed\n", DIRNAME);
+    exit();
+  }
+  strcpy(name, DIRNAME "/f00");
+  start = uptime();
+  for (i = 0; i < NFILES; i++)
+  {
+    name[7] = '0' + i / 10;
+    name[8] = '0' + i % 10;
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    {
+      printf(2, "blocksize_test: cannot create %s\n", name);
+      exit();
+    }
+    write(fd, name, sizeof(name));
+    close(fd);
+  }
+  for (i = 0; i < NFILES; i++)
+  {
+    name[7] = '0' + i / 10;
+    name[8] = '0' + i % 10;
+    if (stat(name, &st) < 0 || unlink(name) < 0)
+    {
+      printf(2, "blocksize_test: cannot remove %s\n", name);
+      exit();
+    }
+  }
+  printf(1, "metadata: %d files created and removed in %d ticks\n", NFILES, uptime() - start);
+  unlink(DIRNAME);
+}
+
+int main(int argc, char *argv[])
+{
+  printf(1, "block size %d bytes\n", BSIZE);
+  sequential();
+  metadata();
+  exit();
+}
@@ -0,0 +1,106 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NBLOCKS 2048  // 1 MB source file
+
+char buf[512];
+char buf2[512];
+
+void fail(char *msg)
+{
+  printf(2, "copy_test: %s\n", msg);
+  exit();
+}
+
+void report(char *how, int ticks)
+{
+  printf(1, "%s: %d KB in %d ticks", how, NBLOCKS / 2, ticks);
+  if (ticks > 0)
+    printf(1, " (%d KB/s)", NBLOCKS / 2 * 100 / ticks);
+  printf(1, "\n");
+}
+
+// Check that file name holds block i tagged with i, for every i.
+void verify(char *name)
+{
+  int fd, i;
+
+  if ((fd = open(name, O_RDONLY)) < 0)
+    fail("cannot open copy");
+  for (i = 0; i < NBLOCKS; i++)
+  {
+    if (read(fd, buf, sizeof(buf)) != sizeof(buf) || *(int *)buf != i)
+    {
+      printf(2, "copy_test: %s: bad block %d\n", name, i);
+      exit();
+    }
+  }
+  if (read(fd, buf, sizeof(buf)) != 0)
+    fail("copy too long");
+  close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+  int fd, out, i, n, start;
+
+  if ((fd = open("copysrc", O_CREATE | O_RDWR)) < 0)
+    fail("cannot create copysrc");
+  for (i = 0; i < NBLOCKS; i++)
+  {
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    *(int *)buf = i;
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write copysrc failed");
+  }
+  close(fd);
+
+  // The old copy_file path: read into a 512-byte buffer and
+  // write it back out, one transaction per write.
+  start = uptime();
+  if ((fd = open("copysrc", O_RDONLY)) < 0 || (out = open("copy1", O_CREATE | O_RDWR)) < 0)
+    fail("cannot open copy1");
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    if (write(out, buf, n) != n)
+      fail("write copy1 failed");
+  close(fd);
+  close(out);
+  report("read/write copy", uptime() - start);
+  verify("copy1");
+
+  start = uptime();
+  if (copy_file("copysrc", "copy2") < 0)
+    fail("copy_file failed");
+  report("block copy_file", uptime() - start);
+  verify("copy2");
+
+  start = uptime();
+  if (reflink_file("copysrc", "copy3") < 0)
+    fail("reflink_file failed");
+  report("reflink_file", uptime() - start);
+  verify("copy3");
+
+  // Writing the reflinked copy must not change the source.
+  if ((fd = open("copy3", O_RDWR)) < 0)
+    fail("cannot open copy3");
+  memset(buf, 'z', sizeof(buf));
+  *(int *)buf = 0;
+  if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+    fail("write copy3 failed");
+  close(fd);
+  if ((fd = open("copysrc", O_RDONLY)) < 0 || read(fd, buf2, sizeof(buf2)) != sizeof(buf2))
+    fail("cannot read copysrc");
+  close(fd);
+  if (buf2[100] != 'a')
+    fail("write to reflinked copy changed the source");
+  printf(1, "copy-on-write ok\n");
+
+  unlink("copy1");
+  unlink("copy2");
+  unlink("copy3");
+  verify("copysrc");
+  unlink("copysrc");
+  exit();
+}
@@ -0,0 +1,90 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define HEAP (8 * 1024 * 1024)
+#define PGSIZE 4096
+#define NFORK 100
+#define NEXEC 20
+
+char *heap;
+
+void fail(char *msg)
+{
+  printf(2, "cow_test: %s\n", msg);
+  exit();
+}
+
+// Writes after fork, by user code or by the kernel in read(),
+// must not show through to the other process.
+void checkcow(void)
+{
+  int fd, p[2];
+  char c;
+
+  heap[0] = 'p';
+  heap[PGSIZE] = 'p';
+  if (pipe(p) < 0)
+    fail("pipe failed");
+  if (fork() == 0)
+  {
+    heap[0] = 'c';
+    if ((fd = open("cow_test", O_RDONLY)) < 0 || read(fd, heap + PGSIZE, 1) != 1)
+      fail("child read into the heap failed");
+    close(fd);
+    read(p[0], &c, 1);
+    if (heap[2 * PGSIZE] != 0)
+      fail("child sees the parent's write");
+    exit();
+  }
+  heap[2 * PGSIZE] = 'p';
+  write(p[1], "x", 1);
+  wait();
+  if (heap[0] != 'p' || heap[PGSIZE] != 'p')
+    fail("parent sees the child's write");
+  close(p[0]);
+  close(p[1]);
+  printf(1, "copy-on-write ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int i, start, t;
+  char *args[] = {"cow_test", "exit", 0};
+
+  if (argc > 1)
+    exit();
+
+  if ((heap = sbrk(HEAP)) == (char *)-1)
+    fail("sbrk failed");
+  for (i = 0; i < HEAP; i += PGSIZE)
+    heap[i] = 0;
+  checkcow();
+
+  start = uptime();
+  for (i = 0; i < NFORK; i++)
+  {
+    if (fork() == 0)
+      exit();
+    wait();
+  }
+  t = uptime() - start;
+  printf(1, "fork+exit with 8 MB heap: %d in %d ticks, %d ms each\n",
+         NFORK, t, t * 10 / NFORK);
+
+  start = uptime();
+  for (i = 0; i < NEXEC; i++)
+  {
+    if (fork() == 0)
+    {
+      exec("cow_test", args);
+      fail("exec failed");
+    }
+    wait();
+  }
+  t = uptime() - start;
+  printf(1, "fork+exec with 8 MB heap: %d in %d ticks, %d ms each\n",
+         NEXEC, t, t * 10 / NEXEC);
+  exit();
+}
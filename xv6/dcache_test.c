@@ -0,0 +1,102 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define DEPTH 8
+#define NENTRIES 400  // a directory spanning many blocks
+#define NOPENS 1000
+
+char deep[64];
+char name[16];
+
+// Time NOPENS opens of path, which should exist if expect is set.
+void timeopen(char *what, char *path, int expect)
+{
+  int i, fd, start;
+
+  start = uptime();
+  for (i = 0; i < NOPENS; i++)
+  {
+    fd = open(path, O_RDONLY);
+    if ((fd >= 0) != expect)
+    {
+      printf(2, "dcache_test: open %s %s\n", path, expect ? "failed" : "succeeded");
+      exit();
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+  printf(1, "%s: %d opens in %d ticks\n", what, NOPENS, uptime() - start);
+}
+
+void mkname(int i)
+{
+  strcpy(name, "big/e000");
+  name[5] = '0' + i / 100;
+  name[6] = '0' + (i / 10) % 10;
+  name[7] = '0' + i % 10;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, fd, n;
+
+  // dc0/dc1/.../dc7/leaf
+  n = 0;
+  for (i = 0; i < DEPTH; i++)
+  {
+    deep[n++] = 'd';
+    deep[n++] = 'c';
+    deep[n++] = '0' + i;
+    deep[n] = 0;
+    if (mkdir(deep) < 0)
+    {
+      printf(2, "dcache_test: mkdir %s failed\n", deep);
+      exit();
+    }
+    deep[n++] = '/';
+  }
+  strcpy(deep + n, "leaf");
+  if ((fd = open(deep, O_CREATE | O_RDWR)) < 0)
+  {
+    printf(2, "dcache_test: cannot create %s\n", deep);
+    exit();
+  }
+  close(fd);
+
+  if (mkdir("big") < 0)
+  {
+    printf(2, "dcache_test: mkdir big failed\n");
+    exit();
+  }
+  for (i = 0; i < NENTRIES; i++)
+  {
+    mkname(i);
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    {
+      printf(2, "dcache_test: cannot create %s\n", name);
+      exit();
+    }
+    close(fd);
+  }
+
+  timeopen("deep path", deep, 1);
+  mkname(NENTRIES - 1);
+  timeopen("last entry of large directory", name, 1);
+  timeopen("missing name in large directory", "big/nothere", 0);
+
+  for (i = 0; i < NENTRIES; i++)
+  {
+    mkname(i);
+    unlink(name);
+  }
+  unlink("big");
+  unlink(deep);
+  for (i = DEPTH - 1; i >= 0; i--)
+  {
+    deep[i * 4 + 3] = 0;
+    unlink(deep);
+  }
+  exit();
+}
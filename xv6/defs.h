@@ -1,12 +1,16 @@
 struct buf;
 struct context;
 struct file;
+struct image;
 struct inode;
+struct kmem_cache;
 struct pipe;
+struct spawnact;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct shpage;
 struct prioritylock;
 struct stat;
 struct superblock;
@@ -16,6 +20,11 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             breadv(uint, uint*, int, struct buf**);
+void            bwritev(struct buf**, int);
+int             setiodepth(int);
+void            bprefetch(uint, uint);
+void            biodone(struct buf*);
 
 // console.c
 void            consoleinit(void);
@@ -25,6 +34,13 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+int             execload(char*, char**, struct image*);
+int             execfault(uint);
+struct inode*   exedup(struct inode*);
+void            exeput(struct inode*);
+void            textinit(void);
+void            textinval(struct inode*);
+void            setprocname(struct proc*, char*);
 
 // file.c
 struct file*    filealloc(void);
@@ -34,14 +50,22 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filepread(struct file*, char*, int n, uint off);
+int             filepwrite(struct file*, char*, int n, uint off);
+int             filesend(struct file*, struct file*, uint*, int);
+int             setreadahead(int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+void            dcput(struct inode*, char*, uint, uint);
+struct inode*   ialloc(uint, short, uint);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
+int             iclone(struct inode*, struct inode*, uint, uint, int);
+void            bfreeinit(int dev);
+void            ifreeinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
@@ -51,6 +75,8 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            iprefetch(struct inode*, uint, uint);
+struct buf*     ibread(struct inode*, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
@@ -58,6 +84,8 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idesubmit(struct buf*);
+void            idewaitrw(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -66,6 +94,11 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kzalloc(void);
+void            kdup(char*);
+int             krefs(char*);
+void            kzerod(void);
+int             kfreepages(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
@@ -88,10 +121,34 @@ void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
 
+// mmap.c
+int             mmapfile(struct file*, uint, int, int, uint);
+int             mmapfault(uint, int);
+int             mmapfork(struct proc*, struct proc*);
+int             mmapuser(uint, uint);
+int             msync(uint, uint);
+int             munmap(uint, uint);
+void            munmapall(void);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            slabdump(void);
+
+// shmem.c
+void            shmeminit(void);
+char*           openshmem(int);
+int             closeshmem(int);
+int             shmemfork(struct proc*, struct proc*);
+void            shmemrelease(struct proc*);
+int             shmemuser(uint, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -101,12 +158,17 @@ int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipewait(struct pipe*);
+int             pipeput(struct pipe*, char*, int);
+int             pipesize(struct pipe*, int);
+void            pipeinit(void);
 
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             spawn(char*, char**, struct spawnact*, int);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
@@ -119,6 +181,7 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(char*, void (*)(void));
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
@@ -150,6 +213,7 @@ void            initsleeplock(struct sleeplock*, char*);
 void acquirepriority(struct prioritylock *);
 void releasepriority(struct prioritylock *);
 void initprioritylock(struct prioritylock *, char *);
+void prioritylockinit(void);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -165,6 +229,7 @@ int             argint(int, int*);
 float           argfloat(int, float*);
 int             argptr(int, char**, int);
 int             argstr(int, char**);
+int             checkuser(uint, uint);
 int             fetchint(uint, int*);
 int             fetchfloat(uint, float*);
 int             fetchstr(uint, char**);
@@ -197,12 +262,17 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             cowfault(uint);
+int             heapfault(uint);
+int             uvmpagein(uint, uint, int);
+uint            residentuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
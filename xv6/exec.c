@@ -6,18 +6,202 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
+// Pages of program files, shared by every process running the
+// program.  execfault() maps them copy-on-write, so a write to
+// a data page gives the writer its own copy while text pages
+// stay shared.  The cache holds one reference to each page.  An
+// inode's pages are dropped when the file is written or truncated
+// or the inode leaves the inode cache, and otherwise the least
+// recently used page makes room for a new one.
+#define NTEXT 256
+
+struct textpage {
+  struct inode *ip;   // 0 if the entry is free
+  uint off;           // file offset of the page's first byte
+  uint n;             // bytes from the file; the rest is zero
+  uint used;          // text.clock at the last lookup
+  char *page;
+};
+
+struct {
+  struct spinlock lock;
+  uint clock;
+  struct textpage pages[NTEXT];
+} text;
+
+void
+textinit(void)
+{
+  initlock(&text.lock, "text");
+}
+
+// Return the cached page holding n bytes of ip at off, with a
+// reference for the caller, or 0.
+static char*
+textlookup(struct inode *ip, uint off, uint n)
+{
+  struct textpage *t;
+  char *page;
+
+  page = 0;
+  acquire(&text.lock);
+  for(t = text.pages; t < &text.pages[NTEXT]; t++){
+    if(t->ip == ip && t->off == off && t->n == n){
+      t->used = ++text.clock;
+      page = t->page;
+      kdup(page);
+      break;
+    }
+  }
+  release(&text.lock);
+  return page;
+}
+
+// Add page to the cache.  Caller holds ip->lock, so that
+// writei() cannot change the file meanwhile.
+static void
+textinsert(struct inode *ip, uint off, uint n, char *page)
+{
+  struct textpage *t, *victim;
+
+  acquire(&text.lock);
+  victim = text.pages;
+  for(t = text.pages; t < &text.pages[NTEXT]; t++){
+    if(t->ip == 0){
+      victim = t;
+      break;
+    }
+    if(t->used < victim->used)
+      victim = t;
+  }
+  if(victim->ip){
+    victim->ip->ntext--;
+    kfree(victim->page);
+  }
+  kdup(page);
+  victim->ip = ip;
+  victim->off = off;
+  victim->n = n;
+  victim->used = ++text.clock;
+  victim->page = page;
+  ip->ntext++;
+  release(&text.lock);
+}
+
+// Drop the cached pages of ip.  Processes that have them
+// mapped keep their references.
+void
+textinval(struct inode *ip)
+{
+  struct textpage *t;
+
+  if(ip->ntext == 0)
+    return;
+  acquire(&text.lock);
+  for(t = text.pages; t < &text.pages[NTEXT]; t++){
+    if(t->ip == ip){
+      kfree(t->page);
+      t->ip = 0;
+    }
+  }
+  ip->ntext = 0;
+  release(&text.lock);
+}
+
+// Take another reference to ip, some process's program, for a
+// new process running it.
+struct inode*
+exedup(struct inode *ip)
+{
+  acquire(&text.lock);
+  ip->nexec++;
+  release(&text.lock);
+  return idup(ip);
+}
+
+// Drop a process's reference to its program ip.  Once no process
+// runs ip, writei() lets it change again.  Caller must be in a
+// transaction, as for iput().
+void
+exeput(struct inode *ip)
+{
+  acquire(&text.lock);
+  ip->nexec--;
+  release(&text.lock);
+  iput(ip);
+}
+
+// Page in the part of a program segment holding va after a
+// fault in the current process.  Returns -1 if va is not in
+// the file-backed part of a segment or is already present,
+// and -2 if it is but the page cannot be read in.
 int
-exec(char *path, char **argv)
+execfault(uint va)
 {
-  char *s, *last;
-  int i, off;
+  struct proc *p = myproc();
+  struct execseg *s;
+  struct inode *ip;
+  pte_t *pte;
+  uint off, n;
+  char *mem;
+
+  if((ip = p->exe) == 0 || va >= p->sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+  for(s = p->seg; s < &p->seg[NEXECSEG]; s++)
+    if(va >= s->va && va - s->va < s->filesz)
+      break;
+  if(s == &p->seg[NEXECSEG])
+    return -1;
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return -1;
+
+  off = s->off + (va - s->va);
+  n = s->filesz - (va - s->va);
+  if(n > PGSIZE)
+    n = PGSIZE;
+  if((mem = textlookup(ip, off, n)) == 0){
+    // Look again with the inode locked, in case another
+    // process read the page in while we waited.
+    ilock(ip);
+    if((mem = textlookup(ip, off, n)) == 0){
+      if((mem = kzalloc()) == 0 || readi(ip, mem, off, n) != n){
+        iunlock(ip);
+        if(mem)
+          kfree(mem);
+        return -2;
+      }
+      textinsert(ip, off, n, mem);
+    }
+    iunlock(ip);
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_U|PTE_COW) < 0){
+    kfree(mem);
+    return -2;
+  }
+  return 0;
+}
+
+// Build a new user address space holding the program at path,
+// with argv set up on its stack, and describe it in img; the
+// caller owns img->pgdir and the reference img->exe.  Only the
+// stack is allocated here: execfault() pages the program in
+// from the file as it runs.
+int
+execload(char *path, char **argv, struct image *img)
+{
+  int i, off, nseg;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  struct execseg *s;
+  pde_t *pgdir;
 
   begin_op();
 
@@ -28,6 +212,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,8 +223,10 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the segments to page in.
   sz = 0;
+  nseg = 0;
+  memset(img->seg, 0, sizeof(img->seg));
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -49,15 +236,27 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz > MMAPBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg == NEXECSEG)
       goto bad;
+    s = &img->seg[nseg++];
+    s->va = ph.vaddr;
+    s->off = ph.off;
+    s->filesz = ph.filesz;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // Count the new process as running ip while it is still locked,
+  // so that no write can slip in before the program is paged in.
+  acquire(&text.lock);
+  ip->nexec++;
+  release(&text.lock);
+  iunlock(ip);
   end_op();
+  exe = ip;
   ip = 0;
 
   // Allocate two pages at the next page boundary.
@@ -87,20 +286,11 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
-  // Save program name for debugging.
-  for(last=s=path; *s; s++)
-    if(*s == '/')
-      last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
-
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
-  curproc->tf->esp = sp;
-  switchuvm(curproc);
-  freevm(oldpgdir);
+  img->pgdir = pgdir;
+  img->sz = sz;
+  img->eip = elf.entry;  // main
+  img->sp = sp;
+  img->exe = exe;
   return 0;
 
  bad:
@@ -110,5 +300,55 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    exeput(exe);
+    end_op();
+  }
   return -1;
 }
+
+// Save the last element of path as p's name, for debugging.
+void
+setprocname(struct proc *p, char *path)
+{
+  char *s, *last;
+
+  for(last=s=path; *s; s++)
+    if(*s == '/')
+      last = s+1;
+  safestrcpy(p->name, last, sizeof(p->name));
+}
+
+int
+exec(char *path, char **argv)
+{
+  struct image img;
+  struct inode *oldexe;
+  pde_t *oldpgdir;
+  struct proc *curproc = myproc();
+
+  if(execload(path, argv, &img) < 0)
+    return -1;
+  setprocname(curproc, path);
+
+  // Commit to the user image.
+  munmapall();
+  shmemrelease(curproc);
+  oldpgdir = curproc->pgdir;
+  oldexe = curproc->exe;
+  curproc->pgdir = img.pgdir;
+  curproc->sz = img.sz;
+  curproc->exe = img.exe;
+  memmove(curproc->seg, img.seg, sizeof(img.seg));
+  curproc->tf->eip = img.eip;
+  curproc->tf->esp = img.sp;
+  switchuvm(curproc);
+  freevm(oldpgdir);
+  if(oldexe){
+    begin_op();
+    exeput(oldexe);
+    end_op();
+  }
+  return 0;
+}
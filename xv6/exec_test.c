@@ -0,0 +1,110 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "spawn.h"
+
+#define NEXEC 50
+#define NSH 16
+
+char *args[] = {"sh", 0};
+
+void fail(char *msg)
+{
+  printf(2, "exec_test: %s\n", msg);
+  exit();
+}
+
+// Start sh with its input from in and its output to out.
+void startsh(int in, int out)
+{
+  struct spawnact act[3];
+
+  act[0].op = SPAWN_DUP;
+  act[0].fd = 0;
+  act[0].src = in;
+  act[1].op = SPAWN_DUP;
+  act[1].fd = 1;
+  act[1].src = out;
+  act[2].op = SPAWN_DUP;
+  act[2].fd = 2;
+  act[2].src = out;
+  if (spawn("sh", args, act, 3) < 0)
+    fail("spawn sh failed");
+}
+
+// Time sh starting up and exiting at once on end of input.
+void latency(void)
+{
+  int in, out, i, start, t;
+
+  if ((in = open("exec_in", O_CREATE | O_RDWR)) < 0 ||
+      (out = open("exec_out", O_CREATE | O_RDWR)) < 0)
+    fail("create failed");
+  start = uptime();
+  for (i = 0; i < NEXEC; i++)
+  {
+    startsh(in, out);
+    wait();
+  }
+  t = uptime() - start;
+  printf(1, "exec sh: %d in %d ticks, %d us each\n",
+         NEXEC, t, t * 10000 / NEXEC);
+  close(in);
+  close(out);
+  unlink("exec_in");
+  unlink("exec_out");
+}
+
+// Run NSH shells at once, all blocked reading their input,
+// and see how much memory they take between them.  Each prints
+// a prompt before it reads, so waiting for NSH prompts means
+// they have all run that far.
+void footprint(void)
+{
+  int in[2], out[2], i, n, before, after;
+  char buf[2 * NSH];
+
+  if (pipe(in) < 0 || pipe(out) < 0)
+    fail("pipe failed");
+  before = freemem();
+  for (i = 0; i < NSH; i++)
+    startsh(in[0], out[1]);
+  for (i = 0; i < sizeof(buf); i += n)
+    if ((n = read(out[0], buf + i, sizeof(buf) - i)) <= 0)
+      fail("read prompts failed");
+  after = freemem();
+  close(in[1]);
+  for (i = 0; i < NSH; i++)
+    wait();
+  close(in[0]);
+  close(out[0]);
+  close(out[1]);
+  printf(1, "%d sh at once: %d KB in all, %d KB each\n",
+         NSH, (before - after) / 1024, (before - after) / 1024 / NSH);
+}
+
+// A running program is paged in from its file, so the file
+// cannot be written while any process runs it.
+void textbusy(void)
+{
+  int fd;
+  char c;
+
+  if ((fd = open("exec_test", O_RDWR)) < 0)
+    fail("cannot open exec_test");
+  if (read(fd, &c, 1) != 1)
+    fail("cannot read exec_test");
+  if (write(fd, &c, 1) >= 0)
+    fail("wrote to a running program");
+  close(fd);
+  printf(1, "running program is not writable ok\n");
+}
+
+int main(void)
+{
+  latency();
+  footprint();
+  textbusy();
+  exit();
+}
@@ -2,3 +2,10 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+#define SEEK_SET  0  // lseek: offset is from start of file
+#define SEEK_CUR  1  // lseek: offset is from current offset
+#define SEEK_END  2  // lseek: offset is from end of file
+
+#define F_SETPIPE_SZ 1031  // fcntl: resize a pipe's buffer
+#define F_GETPIPE_SZ 1032  // fcntl: get a pipe's buffer size
@@ -5,21 +5,32 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "buf.h"
 
 struct devsw devsw[NDEV];
+// File structures come from filecache; ftable.lock protects
+// their reference counts and n, the number allocated.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  int n;
 } ftable;
 
+static struct kmem_cache *filecache;
+
+// Largest read-ahead window, in blocks.  0 disables read-ahead.
+static int ramax = NREADAHEAD;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  filecache = kmem_cache_create("file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -29,15 +40,21 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.n == NFILE){
+    release(&ftable.lock);
+    return 0;
   }
+  ftable.n++;
   release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(filecache)) == 0){
+    acquire(&ftable.lock);
+    ftable.n--;
+    release(&ftable.lock);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -68,7 +85,9 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  ftable.n--;
   release(&ftable.lock);
+  kmem_cache_free(filecache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -92,11 +111,61 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Sequential read detection, called after a read of an inode
+// file that started at offset start.  A read that continues where
+// the previous one ended doubles the read-ahead window, up to ramax
+// blocks; any other read closes it.  The blocks in the window past
+// f->off are then prefetched so the next read finds them cached.
+// Caller must hold f->ip->lock.
+static void
+readahead(struct file *f, uint start)
+{
+  uint bn, end;
+
+  if(start == f->ranext && ramax > 0){
+    f->rawin = f->rawin ? f->rawin * 2 : 2;
+    if(f->rawin > ramax)
+      f->rawin = ramax;
+  } else {
+    f->rawin = 0;
+    f->raend = 0;
+  }
+  f->ranext = f->off;
+  if(f->rawin == 0)
+    return;
+
+  bn = f->off / BSIZE;
+  end = bn + f->rawin;
+  if(bn < f->raend)
+    bn = f->raend;  // already requested
+  if(bn < end){
+    iprefetch(f->ip, bn, end - bn);
+    f->raend = end;
+  }
+}
+
+// Set the largest read-ahead window, in blocks.
+// Returns the old value.
+int
+setreadahead(int nblocks)
+{
+  int old;
+
+  if(nblocks < 0)
+    nblocks = 0;
+  if(nblocks > NREADAHEAD)
+    nblocks = NREADAHEAD;
+  old = ramax;
+  ramax = nblocks;
+  return old;
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
 {
   int r;
+  uint start;
 
   if(f->readable == 0)
     return -1;
@@ -104,54 +173,191 @@ fileread(struct file *f, char *addr, int n)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
+    start = f->off;
+    if((r = readi(f->ip, addr, f->off, n)) > 0){
       f->off += r;
+      readahead(f, start);
+    }
     iunlock(f->ip);
     return r;
   }
   panic("fileread");
 }
 
+// Read from inode file f at offset off, leaving f->off alone.
+// Like read(), returns 0 at or past the end of the file.
+int
+filepread(struct file *f, char *addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type != T_DEV && off >= f->ip->size)
+    r = 0;
+  else
+    r = readi(f->ip, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Move up to n bytes of inode file in straight from the buffer
+// cache into pipe p, a block at a time, reading at *off if off
+// is not 0 and at in's own offset otherwise.  The inode is not
+// locked while waiting for room in the pipe, so a reader of the
+// pipe that uses the same file cannot deadlock with us.
+static int
+sendpipe(struct pipe *p, struct file *in, uint *off, int n)
+{
+  struct inode *ip = in->ip;
+  struct buf *bp;
+  uint o;
+  int m, r, tot;
+
+  for(tot = 0; tot < n; tot += r){
+    if((m = pipewait(p)) < 0)
+      return tot > 0 ? tot : -1;
+    ilock(ip);
+    o = off ? *off : in->off;
+    if(o >= ip->size){
+      iunlock(ip);
+      break;
+    }
+    if(m > n - tot)
+      m = n - tot;
+    if(m > ip->size - o)
+      m = ip->size - o;
+    if(m > BSIZE - o%BSIZE)
+      m = BSIZE - o%BSIZE;
+    bp = ibread(ip, o);
+    r = pipeput(p, (char*)bp->data + o%BSIZE, m);
+    brelse(bp);
+    if(r > 0 && off)
+      *off += r;
+    else if(r > 0){
+      in->off += r;
+      readahead(in, o);
+    }
+    iunlock(ip);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+  }
+  return tot;
+}
+
+// Move up to n bytes from in to out without copying them through
+// user space.  in may be a pipe or an inode; if off is not 0 it
+// gives the offset to read an inode at and is advanced, otherwise
+// in's own offset is used.  A file sent to a pipe goes straight
+// from the buffer cache into the pipe's buffer; anything else
+// goes through a kernel page.  Stops after a short read, so a
+// pipe gives up what it has.  Returns the number of bytes moved.
+int
+filesend(struct file *out, struct file *in, uint *off, int n)
+{
+  char *buf;
+  int m, r, tot, dev;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if(off && in->type != FD_INODE)
+    return -1;
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    ilock(in->ip);
+    dev = in->ip->type == T_DEV;
+    iunlock(in->ip);
+    if(!dev)
+      return sendpipe(out->pipe, in, off, n);
+  }
+  if((buf = kalloc()) == 0)
+    return -1;
+  tot = 0;
+  while(tot < n){
+    m = n - tot;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    if(off)
+      r = filepread(in, buf, m, *off);
+    else
+      r = fileread(in, buf, m);
+    if(r <= 0){
+      if(r < 0 && tot == 0)
+        tot = -1;
+      break;
+    }
+    if(off)
+      *off += r;
+    if(filewrite(out, buf, r) != r){
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < m)
+      break;
+  }
+  kfree(buf);
+  return tot;
+}
+
 //PAGEBREAK!
+// Write n bytes to inode file f at *off, advancing *off.
+static int
+inodewrite(struct file *f, char *addr, int n, uint *off)
+{
+  int r;
+
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect and double-indirect blocks,
+  // allocation blocks, a share map block for
+  // copy-on-write, and 2 blocks of slop for
+  // non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((MAXOPBLOCKS-1-1-1-1-2) / 2) * BSIZE;
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_op();
+    ilock(f->ip);
+    if ((r = writei(f->ip, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_op();
+
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filewrite");
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Write to file f.
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
-
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
-  if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    return i == n ? n : -1;
-  }
+  if(f->type == FD_INODE)
+    return inodewrite(f, addr, n, &f->off);
   panic("filewrite");
 }
 
+// Write to inode file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f, addr, n, &off);
+}
+
@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint ranext;  // offset at which a sequential read would start
+  uint rawin;   // read-ahead window in blocks; 0 if not sequential
+  uint raend;   // first block not yet read ahead
 };
 
 
@@ -14,6 +17,12 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // hash chain; protected by the bucket lock
+  struct inode *prev; // LRU or free list; protected by icache.lock
+  struct inode *next;
+  int onlru;          // on the LRU list? protected by icache.lock
+  int ntext;          // pages in exec's page cache; protected by its lock
+  int nexec;          // processes running the file; same lock as ntext
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -22,7 +31,8 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+  uint hashblk;
 };
 
 // table mapping major device number to
@@ -23,6 +23,8 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dcinit(void);
+static void dcpurge(uint, uint);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -52,24 +54,95 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// In-memory summary of the free bitmap, so that balloc() reads
+// only bitmap blocks that have a free bit, starting where the
+// last allocation left off.  nfree[i] counts the free blocks
+// covered by bitmap block i.  It changes only while that bitmap
+// block's buffer is locked, so it agrees with the bitmap whenever
+// the buffer is not locked.
+struct {
+  struct spinlock lock;
+  int nfree[FSSIZE/BPB + 1];
+  uint hint;  // where a search with no goal starts
+  int nshared;  // blocks whose share map bit is set
+} bfreemap;
+
+// Build the summary from the on-disk bitmap.
+// Must run after log recovery.
+void
+bfreeinit(int dev)
+{
+  int i, bi, n;
+  struct buf *bp;
+
+  initlock(&bfreemap.lock, "bfreemap");
+  if(sb.size > FSSIZE)
+    panic("bfreeinit: fs too big");
+  for(i = 0; i*BPB < sb.size; i++){
+    bp = bread(dev, sb.bmapstart + i);
+    n = 0;
+    for(bi = 0; bi < BPB && i*BPB + bi < sb.size; bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        n++;
+    brelse(bp);
+    bfreemap.nfree[i] = n;
+
+    bp = bread(dev, sb.smapstart + i);
+    for(bi = 0; bi < BPB && i*BPB + bi < sb.size; bi++)
+      if(bp->data[bi/8] & (1 << (bi % 8)))
+        bfreemap.nshared++;
+    brelse(bp);
+  }
+  bfreemap.hint = sb.size - sb.nblocks;
+}
+
+// Allocate a zeroed disk block, preferably the one after
+// block near so that files stay sequential on disk.
+// near == 0 means no preference.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint near)
 {
-  int b, bi, m;
+  int i, n, bi, m, start, free;
+  uint b, bb;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+  acquire(&bfreemap.lock);
+  if(near == 0 || near + 1 >= sb.size)
+    b = bfreemap.hint;
+  else
+    b = near + 1;
+  release(&bfreemap.lock);
+
+  // Visit every bitmap block once, starting with b's, then
+  // the start of b's block again to wrap around.
+  n = (sb.size + BPB - 1) / BPB;
+  for(i = 0; i <= n; i++){
+    bb = (b/BPB + i) % n;
+    start = (i == 0) ? b % BPB : 0;
+    acquire(&bfreemap.lock);
+    free = bfreemap.nfree[bb];
+    release(&bfreemap.lock);
+    if(free == 0)
+      continue;
+    bp = bread(dev, sb.bmapstart + bb);
+    for(bi = start; bi < BPB && bb*BPB + bi < sb.size; bi++){
+      if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+        bi += 7;  // skip a full byte
+        continue;
+      }
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
+        acquire(&bfreemap.lock);
+        bfreemap.nfree[bb]--;
+        bfreemap.hint = bb*BPB + bi + 1;
+        if(bfreemap.hint >= sb.size)
+          bfreemap.hint = sb.size - sb.nblocks;
+        release(&bfreemap.lock);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        bzero(dev, bb*BPB + bi);
+        return bb*BPB + bi;
       }
     }
     brelse(bp);
@@ -77,13 +150,77 @@ balloc(uint dev)
   panic("balloc: out of blocks");
 }
 
-// Free a disk block.
+// Block sharing.  After reflink_file() a data block can belong
+// to two files, and its bit in the share map is set.  The first
+// file to free the block, or to write it (copying it first), just
+// clears the bit; the other file then owns the block alone.  A
+// block is never shared three ways; reflink copies it instead.
+// Bits change only under the share map buffer's lock.
+
+// Mark block b shared.  Returns 0 if it already was.
+static int
+bshare(uint dev, uint b)
+{
+  struct buf *bp;
+  int bi, m;
+
+  bp = bread(dev, SBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if(bp->data[bi/8] & m){
+    brelse(bp);
+    return 0;
+  }
+  bp->data[bi/8] |= m;
+  log_write(bp);
+  acquire(&bfreemap.lock);
+  bfreemap.nshared++;
+  release(&bfreemap.lock);
+  brelse(bp);
+  return 1;
+}
+
+// Return whether block b is shared; if clear is set, also make
+// it unshared.  Skips the share map when no block is shared,
+// which is safe because a block becomes shared only while the
+// files holding it are locked.
+static int
+bshared(uint dev, uint b, int clear)
+{
+  struct buf *bp;
+  int bi, m;
+
+  if(bfreemap.nshared == 0)
+    return 0;
+  bp = bread(dev, SBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if((bp->data[bi/8] & m) == 0){
+    brelse(bp);
+    return 0;
+  }
+  if(clear){
+    bp->data[bi/8] &= ~m;
+    log_write(bp);
+    acquire(&bfreemap.lock);
+    bfreemap.nshared--;
+    release(&bfreemap.lock);
+  }
+  brelse(bp);
+  return 1;
+}
+
+// Free a disk block, or just give up this file's
+// claim on it if another file shares it.
 static void
 bfree(int dev, uint b)
 {
   struct buf *bp;
   int bi, m;
 
+  if(bshared(dev, b, 1))
+    return;
+
   bp = bread(dev, BBLOCK(b, sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
@@ -91,6 +228,9 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&bfreemap.lock);
+  bfreemap.nfree[b/BPB]++;
+  release(&bfreemap.lock);
   brelse(bp);
 }
 
@@ -154,29 +294,67 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// Cache entries hang on hash chains keyed by (dev, inum), one
+// spin-lock per chain, so lookups of different inodes do not
+// contend.  An entry's chain lock protects its ref, dev, inum
+// and hnext; one must hold it while using any of those fields.
+//
+// Entries with ref zero stay on their chain, still valid, and
+// also sit on an LRU list so that a later iget() finds them
+// without reading the disk.  When iget() misses it takes an
+// entry from the free list, grows the cache from kalloc() until
+// it holds MAXINODE entries, and after that recycles the least
+// recently used entry.  The icache.lock spin-lock protects the
+// LRU and free lists and ip->onlru.  Lock order is chain lock,
+// then icache.lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 127
+#define IHASH(dev, inum) (((dev)*31 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
+  struct inode lru;    // head of LRU list; lru.next is least recent
+  struct inode *free;  // entries on no chain, linked by next
+  int n;               // number of entries, static and grown
   struct inode inode[NINODE];
+  struct {
+    struct spinlock lock;
+    struct inode *head;
+  } bucket[NIHASH];
 } icache;
 
+// Put entries ip[0..n-1] on the free list.
+static void
+ifreelist(struct inode *ip, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    initsleeplock(&ip[i].lock, "inode");
+    acquire(&icache.lock);
+    ip[i].next = icache.free;
+    icache.free = &ip[i];
+    icache.n++;
+    release(&icache.lock);
+  }
+}
+
 void
 iinit(int dev)
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  dcinit();
+  icache.lru.prev = &icache.lru;
+  icache.lru.next = &icache.lru;
+  for(i = 0; i < NIHASH; i++)
+    initlock(&icache.bucket[i].lock, "icache.bucket");
+  ifreelist(icache.inode, NINODE);
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -187,30 +365,113 @@ iinit(int dev)
 
 static struct inode* iget(uint dev, uint inum);
 
-//PAGEBREAK!
-// Allocate an inode on device dev.
-// Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
-struct inode*
-ialloc(uint dev, short type)
+// In-memory map of the on-disk inodes, one bit per inode, set if
+// the inode is allocated or being allocated.  ialloc() claims an
+// inode here before writing its type to disk; iput() clears the
+// bit only after it has written type 0.  Every inode below lowest
+// is allocated.
+struct {
+  struct spinlock lock;
+  uchar used[NINODES/8 + 1];
+  uint lowest;
+} ifreemap;
+
+// Build the map from the inode blocks.
+// Must run after log recovery.
+void
+ifreeinit(int dev)
 {
   int inum;
   struct buf *bp;
   struct dinode *dip;
 
+  initlock(&ifreemap.lock, "ifreemap");
+  if(sb.ninodes > NINODES)
+    panic("ifreeinit: too many inodes");
+  ifreemap.used[0] |= 1;  // inode 0 is never used
+  bp = 0;
   for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+    if(bp == 0 || inum%IPB == 0){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
     dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+    if(dip->type != 0)
+      ifreemap.used[inum/8] |= 1 << (inum%8);
+  }
+  brelse(bp);
+  ifreemap.lowest = 1;
+}
+
+// Claim a free inode number in the map, looking first at or
+// after near.  Returns 0 if there are none.
+static uint
+iclaim(uint near)
+{
+  uint start, inum, i;
+
+  acquire(&ifreemap.lock);
+  start = near > ifreemap.lowest && near < sb.ninodes ? near : ifreemap.lowest;
+  inum = start;
+  for(i = 0; i < sb.ninodes; i++, inum++){
+    if(inum >= sb.ninodes)
+      inum = ifreemap.lowest;
+    if(inum%8 == 0 && ifreemap.used[inum/8] == 0xff && inum + 8 <= sb.ninodes){
+      if(inum == ifreemap.lowest)
+        ifreemap.lowest += 8;
+      inum += 7;  // skip a full byte
+      i += 7;
+      continue;
     }
-    brelse(bp);
+    if((ifreemap.used[inum/8] & (1 << (inum%8))) == 0){
+      ifreemap.used[inum/8] |= 1 << (inum%8);
+      if(inum == ifreemap.lowest)
+        ifreemap.lowest++;
+      release(&ifreemap.lock);
+      return inum;
+    }
+    if(inum == ifreemap.lowest)
+      ifreemap.lowest++;
   }
-  panic("ialloc: no inodes");
+  release(&ifreemap.lock);
+  return 0;
+}
+
+// Return inode inum to the map.
+static void
+iunclaim(uint inum)
+{
+  acquire(&ifreemap.lock);
+  ifreemap.used[inum/8] &= ~(1 << (inum%8));
+  if(inum < ifreemap.lowest)
+    ifreemap.lowest = inum;
+  release(&ifreemap.lock);
+}
+
+//PAGEBREAK!
+// Allocate an inode on device dev, near inode near if possible,
+// so that a directory's files share its inode blocks.
+// Mark it as allocated by  giving it type type.
+// Returns an unlocked but allocated and referenced inode.
+struct inode*
+ialloc(uint dev, short type, uint near)
+{
+  uint inum;
+  struct buf *bp;
+  struct dinode *dip;
+
+  if((inum = iclaim(near)) == 0)
+    panic("ialloc: no inodes");
+  bp = bread(dev, IBLOCK(inum, sb));
+  dip = (struct dinode*)bp->data + inum%IPB;
+  if(dip->type != 0)
+    panic("ialloc: inode in use");
+  memset(dip, 0, sizeof(*dip));
+  dip->type = type;
+  log_write(bp);   // mark it allocated on the disk
+  brelse(bp);
+  return iget(dev, inum);
 }
 
 // Copy a modified in-memory inode to disk.
@@ -231,10 +492,79 @@ iupdate(struct inode *ip)
   dip->nlink = ip->nlink;
   dip->size = ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->hashblk = ip->hashblk;
   log_write(bp);
   brelse(bp);
 }
 
+// Take a reference to ip, found on its chain.
+// Caller holds the chain lock.
+static void
+iref(struct inode *ip)
+{
+  if(ip->ref++ == 0){
+    acquire(&icache.lock);
+    if(ip->onlru){
+      ip->prev->next = ip->next;
+      ip->next->prev = ip->prev;
+      ip->onlru = 0;
+    }
+    release(&icache.lock);
+  }
+}
+
+// Return an entry that is on no chain and has no references,
+// from the free list, a new kalloc() page, or the LRU list.
+static struct inode*
+ivictim(void)
+{
+  struct inode *ip, **pp;
+  char *mem;
+  int h;
+
+  for(;;){
+    acquire(&icache.lock);
+    if((ip = icache.free) != 0){
+      icache.free = ip->next;
+      release(&icache.lock);
+      return ip;
+    }
+    if(icache.n < MAXINODE){
+      release(&icache.lock);
+      if((mem = kzalloc()) != 0){
+        ifreelist((struct inode*)mem, PGSIZE / sizeof(struct inode));
+        continue;
+      }
+      acquire(&icache.lock);
+    }
+
+    // Recycle the least recently used entry.  Its chain lock comes
+    // before icache.lock, so note the chain, lock both, and check
+    // that nobody revived or recycled the entry meanwhile.  While
+    // the entry is on the LRU list its dev and inum cannot change.
+    if((ip = icache.lru.next) == &icache.lru)
+      panic("iget: no inodes");
+    h = IHASH(ip->dev, ip->inum);
+    release(&icache.lock);
+    acquire(&icache.bucket[h].lock);
+    acquire(&icache.lock);
+    if(ip->onlru && IHASH(ip->dev, ip->inum) == h){
+      ip->prev->next = ip->next;
+      ip->next->prev = ip->prev;
+      ip->onlru = 0;
+      release(&icache.lock);
+      for(pp = &icache.bucket[h].head; *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+      release(&icache.bucket[h].lock);
+      textinval(ip);
+      return ip;
+    }
+    release(&icache.lock);
+    release(&icache.bucket[h].lock);
+  }
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
@@ -242,31 +572,45 @@ static struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
+  int h;
 
-  acquire(&icache.lock);
+  h = IHASH(dev, inum);
+  acquire(&icache.bucket[h].lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = icache.bucket[h].head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      iref(ip);
+      release(&icache.bucket[h].lock);
+      return ip;
+    }
+  }
+  release(&icache.bucket[h].lock);
+
+  // Recycle an inode cache entry.  The chain lock was dropped
+  // to find one, so look again before inserting it.
+  empty = ivictim();
+  acquire(&icache.bucket[h].lock);
+  for(ip = icache.bucket[h].head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      iref(ip);
+      release(&icache.bucket[h].lock);
+      acquire(&icache.lock);
+      empty->next = icache.free;
+      icache.free = empty;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&icache.lock);
+  ip->hnext = icache.bucket[h].head;
+  icache.bucket[h].head = ip;
+  release(&icache.bucket[h].lock);
 
   return ip;
 }
@@ -276,9 +620,12 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  int h;
+
+  h = IHASH(ip->dev, ip->inum);
+  acquire(&icache.bucket[h].lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&icache.bucket[h].lock);
   return ip;
 }
 
@@ -304,6 +651,7 @@ ilock(struct inode *ip)
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->hashblk = dip->hashblk;
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -322,8 +670,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry goes
+// on the LRU list and can be recycled.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -331,24 +679,38 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  int h;
+
+  h = IHASH(ip->dev, ip->inum);
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
+    acquire(&icache.bucket[h].lock);
     int r = ip->ref;
-    release(&icache.lock);
+    release(&icache.bucket[h].lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
+      if(ip->type == T_DIR)
+        dcpurge(ip->dev, ip->inum);
       ip->type = 0;
       iupdate(ip);
       ip->valid = 0;
+      iunclaim(ip->inum);
     }
   }
   releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
-  ip->ref--;
-  release(&icache.lock);
+  acquire(&icache.bucket[h].lock);
+  if(--ip->ref == 0){
+    acquire(&icache.lock);
+    ip->next = &icache.lru;
+    ip->prev = icache.lru.prev;
+    icache.lru.prev->next = ip;
+    icache.lru.prev = ip;
+    ip->onlru = 1;
+    release(&icache.lock);
+  }
+  release(&icache.bucket[h].lock);
 }
 
 // Common idiom: unlock, then put.
@@ -365,33 +727,73 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The last NDINDIRECT
+// blocks are reached through the double-indirect block
+// ip->addrs[NDIRECT+1], which lists NINDIRECT indirect blocks.
+
+// Fill in *slot, the address of one data block, which lives in
+// buffer bp, or in the inode if bp is 0.  If set is non-zero,
+// *slot becomes set and the block it replaces is freed.
+// Otherwise an empty slot gets a new block next to block near.
+static uint
+bleaf(struct inode *ip, struct buf *bp, uint *slot, uint near, uint set)
+{
+  uint old;
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+  old = *slot;
+  if(set)
+    *slot = set;
+  else if(old == 0)
+    *slot = balloc(ip->dev, near);
+  else
+    return old;
+  if(bp)
+    log_write(bp);
+  if(set && old && old != set)
+    bfree(ip->dev, old);
+  return *slot;
+}
+
+// Walk to the nth block of inode ip, allocating indirect
+// blocks as needed, and fill in its address with bleaf().
 static uint
-bmap(struct inode *ip, uint bn)
+bwalk(struct inode *ip, uint bn, uint set)
 {
   uint addr, *a;
   struct buf *bp;
 
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
-    return addr;
-  }
+  if(bn < NDIRECT)
+    return bleaf(ip, 0, &ip->addrs[bn], bn > 0 ? ip->addrs[bn-1] : 0, set);
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, ip->addrs[NDIRECT-1]);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    addr = bleaf(ip, bp, &a[bn], bn > 0 ? a[bn-1] : addr, set);
+    brelse(bp);
+    return addr;
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, then the indirect block
+    // below it, allocating either if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev, 0);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if(a[bn / NINDIRECT] == 0){
+      a[bn / NINDIRECT] = balloc(ip->dev, bn / NINDIRECT > 0 ? a[bn/NINDIRECT - 1] : addr);
       log_write(bp);
     }
+    addr = a[bn / NINDIRECT];
+    brelse(bp);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    addr = bleaf(ip, bp, &a[bn % NINDIRECT], bn % NINDIRECT > 0 ? a[bn%NINDIRECT - 1] : addr, set);
     brelse(bp);
     return addr;
   }
@@ -399,6 +801,23 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one, next to the
+// file's previous block when that block is free.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  return bwalk(ip, bn, 0);
+}
+
+// Make block addr the nth block of inode ip, freeing the
+// block it replaces.  Caller must iupdate(ip).
+static void
+bremap(struct inode *ip, uint bn, uint addr)
+{
+  bwalk(ip, bn, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -407,10 +826,11 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i, j, k;
+  struct buf *bp, *bp2;
+  uint *a, *a2;
 
+  textinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -430,6 +850,31 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j] == 0)
+        continue;
+      bp2 = bread(ip->dev, a[j]);
+      a2 = (uint*)bp2->data;
+      for(k = 0; k < NINDIRECT; k++){
+        if(a2[k])
+          bfree(ip->dev, a2[k]);
+      }
+      brelse(bp2);
+      bfree(ip->dev, a[j]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
+  if(ip->hashblk){
+    bfree(ip->dev, ip->hashblk);
+    ip->hashblk = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
@@ -452,8 +897,9 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, bn, nb, blocknos[NIODEPTH];
+  struct buf *bps[NIODEPTH];
+  int i, k;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
@@ -466,15 +912,116 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
-    brelse(bp);
+  // Map a batch of blocks, then let breadv keep their
+  // reads in flight together.
+  for(tot=0; tot<n; ){
+    bn = off/BSIZE;
+    nb = (off + (n - tot) - 1)/BSIZE - bn + 1;
+    if(nb > NIODEPTH)
+      nb = NIODEPTH;
+    for(i = 0; i < nb; i++)
+      blocknos[i] = bmap(ip, bn + i);
+    k = breadv(ip->dev, blocknos, nb, bps);
+    for(i = 0; i < k; i++, tot+=m, off+=m, dst+=m){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      memmove(dst, bps[i]->data + off%BSIZE, m);
+      brelse(bps[i]);
+    }
   }
   return n;
 }
 
+// Return the locked buffer holding byte off of ip, which must
+// lie inside the file.  Caller must hold ip->lock.
+struct buf*
+ibread(struct inode *ip, uint off)
+{
+  return bread(ip->dev, bmap(ip, off/BSIZE));
+}
+
+// Start reading blocks bn..bn+n-1 of ip into the buffer cache
+// without waiting for them.  Blocks past the end of the file
+// are skipped.  Caller must hold ip->lock.
+void
+iprefetch(struct inode *ip, uint bn, uint n)
+{
+  uint last;
+
+  if(ip->type == T_DEV || ip->size == 0)
+    return;
+  last = (ip->size - 1) / BSIZE;
+  for(; n > 0 && bn <= last; bn++, n--)
+    bprefetch(ip->dev, bmap(ip, bn));
+}
+
+// Give ip its own copy of its nth block, at addr, if another
+// file shares it.  Returns the address to write.
+static uint
+icow(struct inode *ip, uint bn, uint addr)
+{
+  struct buf *from, *to;
+  uint copy;
+
+  if(!bshared(ip->dev, addr, 0))
+    return addr;
+  copy = balloc(ip->dev, addr);
+  from = bread(ip->dev, addr);
+  to = bread(ip->dev, copy);
+  memmove(to->data, from->data, BSIZE);
+  log_write(to);
+  brelse(from);
+  brelse(to);
+  bremap(ip, bn, copy);  // unshares addr
+  iupdate(ip);
+  return copy;
+}
+
+// Copy blocks [bn, bn+n) of src to the same place in dst, and
+// grow dst to match.  Each block goes through the buffer cache
+// straight from src to dst.  If share is set, dst instead takes
+// the blocks themselves, shared copy-on-write; to bound the log
+// space used, the call then stops before a third share map block,
+// and a block that is already shared is copied in a call of its
+// own.  Caller must hold both locks and be in a transaction.
+// Returns the number of blocks done, or -1.
+int
+iclone(struct inode *dst, struct inode *src, uint bn, uint n, int share)
+{
+  struct buf *from, *to;
+  uint i, addr, sblk, nsblk;
+
+  if(src->type != T_FILE || dst->type != T_FILE)
+    return -1;
+  sblk = nsblk = 0;
+  for(i = bn; i < bn + n && i*BSIZE < src->size; i++){
+    addr = bmap(src, i);
+    if(share){
+      if(SBLOCK(addr, sb) != sblk){
+        if(nsblk++ == 2)
+          break;
+        sblk = SBLOCK(addr, sb);
+      }
+      if(bshare(src->dev, addr)){
+        bremap(dst, i, addr);
+        continue;
+      }
+      if(i > bn)
+        break;
+      n = 1;
+    }
+    from = bread(src->dev, addr);
+    to = bread(dst->dev, icow(dst, i, bmap(dst, i)));
+    memmove(to->data, from->data, BSIZE);
+    log_write(to);
+    brelse(from);
+    brelse(to);
+  }
+  if(i > bn)
+    dst->size = min(src->size, i*BSIZE);
+  iupdate(dst);
+  return i - bn;
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -490,13 +1037,19 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return devsw[ip->major].write(ip, src, n);
   }
 
+  // Pages of a running program are read from the file as it
+  // runs, so changing the file would mix old and new code.
+  if(ip->nexec > 0)
+    return -1;
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  // MAXFILE*BSIZE overflows a uint for large block sizes.
+  if(off + n > (unsigned long long)MAXFILE*BSIZE)
     return -1;
+  textinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, icow(ip, off/BSIZE, bmap(ip, off/BSIZE)));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
@@ -519,32 +1072,280 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Name cache: maps (directory, name) to the inum and offset of
+// the matching dirent, or records that the name is absent
+// (inum 0).  Callers hold the directory's sleep-lock, so all
+// updates for one directory are serialized; dcache.lock only
+// guards the table itself.  dirlink() and sys_unlink() update
+// entries as they change a directory, and iput() purges a
+// directory's entries when it frees the directory.
+
+#define NDCHASH 127
+
+struct dcentry {
+  uint dev;
+  uint dinum;     // directory inode number; 0 if unused
+  char name[DIRSIZ];
+  uint inum;      // 0 if name is known to be absent
+  uint off;       // offset of the dirent in the directory
+  struct dcentry *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dcentry entry[NDCACHE];
+  struct dcentry *head[NDCHASH];
+  int hand;       // next entry to replace
+} dcache;
+
+static void
+dcinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static uint
+dchash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev*31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + name[i];
+  return h % NDCHASH;
+}
+
+static struct dcentry*
+dcfind(uint dev, uint dinum, char *name)
+{
+  struct dcentry *e;
+
+  for(e = dcache.head[dchash(dev, dinum, name)]; e; e = e->next)
+    if(e->dev == dev && e->dinum == dinum && namecmp(e->name, name) == 0)
+      return e;
+  return 0;
+}
+
+static void
+dcunhash(struct dcentry *e)
+{
+  struct dcentry **pp;
+
+  pp = &dcache.head[dchash(e->dev, e->dinum, e->name)];
+  for(; *pp != e; pp = &(*pp)->next)
+    ;
+  *pp = e->next;
+  e->dinum = 0;
+}
+
+// Look up name in directory dp's cached entries.
+// Returns 0 and fills in *inum and *off on a hit, -1 on a miss.
+static int
+dcget(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dp->dev, dp->inum, name)) == 0){
+    release(&dcache.lock);
+    return -1;
+  }
+  *inum = e->inum;
+  *off = e->off;
+  release(&dcache.lock);
+  return 0;
+}
+
+// Record that name in directory dp is inode inum at offset off,
+// or is absent if inum is 0.  Caller holds dp's lock.
+void
+dcput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dcentry *e;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dp->dev, dp->inum, name)) == 0){
+    e = &dcache.entry[dcache.hand];
+    dcache.hand = (dcache.hand + 1) % NDCACHE;
+    if(e->dinum)
+      dcunhash(e);
+    e->dev = dp->dev;
+    e->dinum = dp->inum;
+    strncpy(e->name, name, DIRSIZ);
+    h = dchash(e->dev, e->dinum, e->name);
+    e->next = dcache.head[h];
+    dcache.head[h] = e;
+  }
+  e->inum = inum;
+  e->off = off;
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory dinum, which is being freed.
+static void
+dcpurge(uint dev, uint dinum)
+{
+  int i;
+
+  acquire(&dcache.lock);
+  for(i = 0; i < NDCACHE; i++)
+    if(dcache.entry[i].dinum == dinum && dcache.entry[i].dev == dev)
+      dcunhash(&dcache.entry[i]);
+  release(&dcache.lock);
+}
+
+// Search bytes [start, end) of directory dp, a few entries
+// at a time, for name, or for an empty slot if name is 0.
+// Returns the offset of the entry, or -1.
+static int
+dirscan(struct inode *dp, char *name, uint start, uint end)
+{
+  uint off;
+  struct dirent de[16];
+  int i, n;
+
+  for(off = start; off < end; off += n){
+    n = min(sizeof(de), end - off);
+    if(readi(dp, (char*)de, off, n) != n || n % sizeof(de[0]) != 0)
+      panic("dirscan read");
+    for(i = 0; i < n / sizeof(de[0]); i++){
+      if(name == 0 && de[i].inum == 0)
+        return off + i*sizeof(de[0]);
+      if(name != 0 && de[i].inum != 0 && namecmp(name, de[i].name) == 0)
+        return off + i*sizeof(de[0]);
+    }
+  }
+  return -1;
+}
+
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Read a field of hashed directory dp's struct dirindex.
+#define DIRINDEX(dp, field) dirindex(dp, (uint)&((struct dirindex*)0)->field)
+
+static uint
+dirindex(struct inode *dp, uint byteoff)
+{
+  struct buf *bp;
+  uint v;
+
+  bp = bread(dp->dev, dp->hashblk);
+  v = *(ushort*)(bp->data + byteoff);
+  brelse(bp);
+  return v;
+}
+
+// Search directory dp for name, or for an empty slot if name
+// is 0.  In a hashed directory only the linear blocks and the
+// name's hash chain can hold it.  Returns the offset or -1.
+static int
+dirsearch(struct inode *dp, char *name, uint h)
+{
+  uint bn;
+  int off;
+
+  if(dp->hashblk == 0)
+    return dirscan(dp, name, 0, dp->size);
+  if(name && (off = dirscan(dp, name, 0, DIRINDEX(dp, nlinear)*BSIZE)) >= 0)
+    return off;
+  for(bn = DIRINDEX(dp, head[h]); bn != 0; bn = DIRINDEX(dp, next[bn]))
+    if((off = dirscan(dp, name, bn*BSIZE, (bn+1)*BSIZE)) >= 0)
+      return off;
+  return -1;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint inum, off;
   struct dirent de;
+  int o;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  if(dcget(dp, name, &inum, &off) == 0){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
   }
 
-  return 0;
+  if((o = dirsearch(dp, name, dirhash(name))) < 0){
+    dcput(dp, name, 0, 0);
+    return 0;
+  }
+  // entry matches path element
+  if(readi(dp, (char*)&de, o, sizeof(de)) != sizeof(de))
+    panic("dirlookup read");
+  if(poff)
+    *poff = o;
+  inum = de.inum;
+  dcput(dp, name, inum, o);
+  return iget(dp->dev, inum);
+}
+
+// Turn linear directory dp into a hashed one whose current
+// blocks all stay linear.
+static void
+dirhashinit(struct inode *dp)
+{
+  struct buf *bp;
+
+  dp->hashblk = balloc(dp->dev, 0);
+  bp = bread(dp->dev, dp->hashblk);
+  ((struct dirindex*)bp->data)->nlinear = dp->size / BSIZE;
+  log_write(bp);
+  brelse(bp);
+  iupdate(dp);
+}
+
+// Find room for a name with hash h in hashed directory dp,
+// adding a block to h's chain if its blocks are full.
+// Returns the offset of an empty slot, or -1 if dp is full.
+static int
+dirhashslot(struct inode *dp, uint h)
+{
+  struct buf *bp;
+  struct dirindex *idx;
+  struct dirent de;
+  int off;
+  uint bn;
+
+  if((off = dirsearch(dp, 0, h)) >= 0)
+    return off;
+
+  bn = dp->size / BSIZE;
+  if(bn >= NDCHAIN)
+    return -1;
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, (char*)&de, bn*BSIZE, sizeof(de)) != sizeof(de))
+    panic("dirhashslot");
+  dp->size = (bn+1)*BSIZE;  // balloc zeroed the rest of the block
+  iupdate(dp);
+
+  bp = bread(dp->dev, dp->hashblk);
+  idx = (struct dirindex*)bp->data;
+  idx->next[bn] = idx->head[h];
+  idx->head[h] = bn;
+  log_write(bp);
+  brelse(bp);
+  return bn*BSIZE;
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -561,18 +1362,23 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  // Look for an empty dirent.  A linear directory grows by
+  // appending until it fills a block, and then becomes hashed.
+  if(dp->hashblk == 0){
+    if((off = dirscan(dp, 0, 0, dp->size)) < 0){
+      off = dp->size;
+      if(off >= BSIZE && off % BSIZE == 0)
+        dirhashinit(dp);
+    }
   }
+  if(dp->hashblk && (off = dirhashslot(dp, dirhash(name))) < 0)
+    return -1;
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcput(dp, name, inum, off);
 
   return 0;
 }
@@ -3,11 +3,13 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#ifndef BSIZE
+#define BSIZE 512  // block size; a multiple of 512, at most 8192
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                          free bit map | share bit map | data blocks]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -19,11 +21,13 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint smapstart;    // Block number of first share map block
 };
 
-#define NDIRECT 12
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,7 +36,8 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
+  uint hashblk;         // Index block of a hashed directory, or 0
 };
 
 // Inodes per block.
@@ -47,6 +52,9 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) (b/BPB + sb.bmapstart)
 
+// Block of share map containing bit for block b
+#define SBLOCK(b, sb) (b/BPB + sb.smapstart)
+
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
 
@@ -55,3 +63,17 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory that outgrows its first blocks becomes hashed:
+// the blocks it has then stay linear and are always searched,
+// and each later block holds only names of one hash chain.
+// The directory's hashblk points at this index of the chains,
+// which are lists of block numbers within the directory.
+#define NDHASH 32  // hash chains per directory
+#define NDCHAIN (BSIZE/sizeof(ushort) - 1 - NDHASH)  // max blocks in a hashed directory
+
+struct dirindex {
+  ushort nlinear;          // blocks below this are linear
+  ushort head[NDHASH];     // first block of each chain, 0 if empty
+  ushort next[NDCHAIN];    // next block in the same chain, 0 at the end
+};
+
@@ -0,0 +1,60 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NFILES 200  // more than the 50 inodes cached at boot
+#define NPASSES 20
+
+char name[8];
+
+void mkname(int i)
+{
+  name[0] = 'i';
+  name[1] = 'c';
+  name[2] = '0' + i / 100;
+  name[3] = '0' + (i / 10) % 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+}
+
+int main(int argc, char *argv[])
+{
+  struct stat st;
+  int i, pass, fd, start;
+
+  for (i = 0; i < NFILES; i++)
+  {
+    mkname(i);
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    {
+      printf(2, "icache_test: cannot create %s\n", name);
+      exit();
+    }
+    close(fd);
+  }
+
+  // Once the working set fits in the inode cache, every
+  // stat after the first pass is served without disk reads.
+  start = uptime();
+  for (pass = 0; pass < NPASSES; pass++)
+  {
+    for (i = 0; i < NFILES; i++)
+    {
+      mkname(i);
+      if (stat(name, &st) < 0)
+      {
+        printf(2, "icache_test: stat %s failed\n", name);
+        exit();
+      }
+    }
+  }
+  printf(1, "%d stats of %d files in %d ticks\n", NPASSES * NFILES, NFILES, uptime() - start);
+
+  for (i = 0; i < NFILES; i++)
+  {
+    mkname(i);
+    unlink(name);
+  }
+  exit();
+}
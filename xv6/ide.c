@@ -23,6 +23,8 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define MAXMULSECTORS 16  // most sectors a READ/WRITE MULTIPLE may move
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
@@ -65,6 +67,21 @@ ideinit(void)
     }
   }
 
+  // A block larger than a sector moves with READ/WRITE MULTIPLE,
+  // so set each disk's multiple count to a whole block.  Mask the
+  // disk's interrupt meanwhile; idestart() unmasks it.
+  if(BSIZE/SECTOR_SIZE > 1){
+    if(BSIZE/SECTOR_SIZE > MAXMULSECTORS)
+      panic("ideinit: BSIZE");
+    outb(0x3f6, 2);
+    for(i = 0; i <= havedisk1; i++){
+      outb(0x1f6, 0xe0 | (i<<4));
+      outb(0x1f2, BSIZE/SECTOR_SIZE);
+      outb(0x1f7, IDE_CMD_SETMUL);
+      idewait(0);
+    }
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
@@ -82,7 +99,7 @@ idestart(struct buf *b)
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
   int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (sector_per_block > MAXMULSECTORS) panic("idestart");
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
@@ -121,7 +138,10 @@ ideintr(void)
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
-  wakeup(b);
+  if(b->flags & B_ASYNC)
+    biodone(b);  // nobody waits for a prefetch
+  else
+    wakeup(b);
 
   // Start disk on next buf in queue.
   if(idequeue != 0)
@@ -131,20 +151,21 @@ ideintr(void)
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// Queue b for the disk and return without waiting.
+// If B_DIRTY is set, b will be written, else it will be read.
+// The caller keeps b->lock and must call idewaitrw(b)
+// before using or releasing the buffer.
 void
-iderw(struct buf *b)
+idesubmit(struct buf *b)
 {
   struct buf **pp;
 
   if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
+    panic("idesubmit: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
+    panic("idesubmit: nothing to do");
   if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+    panic("idesubmit: ide disk 1 not present");
 
   acquire(&idelock);  //DOC:acquire-lock
 
@@ -158,11 +179,26 @@ iderw(struct buf *b)
   if(idequeue == b)
     idestart(b);
 
-  // Wait for request to finish.
+  release(&idelock);
+}
+
+// Wait for a request queued by idesubmit() to finish.
+void
+idewaitrw(struct buf *b)
+{
+  acquire(&idelock);
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
-
-
   release(&idelock);
 }
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  idesubmit(b);
+  idewaitrw(b);
+}
@@ -0,0 +1,89 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "fs.h"
+
+#define FILENAME "iodepth.tmp"
+#define NBLOCKS (4 * NBUF)  // larger than the buffer cache
+#define NPASSES 8
+
+char buf[8192];
+
+// Read the whole file NPASSES times, checking that each block
+// holds its own number, and return the ticks taken.
+int read_passes(void)
+{
+  int fd, pass, start, n, off, i;
+
+  start = uptime();
+  for (pass = 0; pass < NPASSES; pass++)
+  {
+    if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    {
+      printf(2, "iodepth_test: cannot open %s\n", FILENAME);
+      exit();
+    }
+    off = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+      for (i = 0; i < n; i++)
+        if (buf[i] != (char)((off + i) / BSIZE))
+        {
+          printf(2, "iodepth_test: wrong data at offset %d\n", off + i);
+          exit();
+        }
+      off += n;
+    }
+    close(fd);
+    if (off != NBLOCKS * BSIZE)
+    {
+      printf(2, "iodepth_test: read %d bytes, not %d\n", off, NBLOCKS * BSIZE);
+      exit();
+    }
+  }
+  return uptime() - start;
+}
+
+void report(int depth)
+{
+  int ticks, kb;
+
+  set_io_queue_depth(depth);
+  ticks = read_passes();
+  kb = NBLOCKS * BSIZE / 1024 * NPASSES;
+  printf(1, "queue depth %d: %d KB in %d ticks", depth, kb, ticks);
+  if (ticks > 0)
+    printf(1, " (%d KB/s)", kb * 100 / ticks);
+  printf(1, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int fd, i, old;
+
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+  {
+    printf(2, "iodepth_test: cannot create %s\n", FILENAME);
+    exit();
+  }
+  for (i = 0; i < NBLOCKS; i++)
+  {
+    memset(buf, i, BSIZE);
+    if (write(fd, buf, BSIZE) != BSIZE)
+    {
+      printf(2, "iodepth_test: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+
+  old = set_io_queue_depth(1);
+  report(1);
+  report(8);
+  set_io_queue_depth(old);
+
+  unlink(FILENAME);
+  exit();
+}
@@ -8,6 +8,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "x86.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -21,17 +22,58 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int n;
 } kmem;
 
+// Each CPU keeps a cache of free pages so that most kalloc()
+// and kfree() calls touch only that CPU's list.  An empty cache
+// is refilled from kmem with KBATCH pages at once, or by stealing
+// half of another CPU's cache; a cache that grows past KCACHE
+// pages drains KBATCH of them back to kmem.  The per-CPU lock is
+// only contended while another CPU steals.
+#define KCACHE 64
+#define KBATCH 16
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kcaches[NCPU];
+
+// Reference counts of physical pages, so that copy-on-write
+// fork can share a page between page tables.  kalloc() sets the
+// count to 1, kdup() adds one, and kfree() only puts the page
+// back once the count drops to 0.
+static int refs[PHYSTOP/PGSIZE];
+#define PAGEREF(v) refs[V2P(v)/PGSIZE]
+
+// Pages cleared ahead of time by kzerod for kzalloc(), so that
+// callers needing zeroed memory do not clear it inline.  kzerod
+// fills the pool to ZPOOL pages and sleeps until it has drained
+// to half of that.  kalloc() falls back on it when memory runs out.
+#define ZPOOL 256
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Until then kalloc() and kfree() use kmem directly.
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kcaches[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -51,6 +93,62 @@ freerange(void *vstart, void *vend)
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
     kfree(p);
 }
+
+// Unlink up to n pages from the front of *list and
+// return them as a chain, setting *got to the count.
+static struct run*
+ktake(struct run **list, int n, int *got)
+{
+  struct run *head, *rest, **pp;
+  int i;
+
+  head = *list;
+  pp = list;
+  for(i = 0; i < n && *pp; i++)
+    pp = &(*pp)->next;
+  rest = *pp;
+  *pp = 0;
+  *list = rest;
+  *got = i;
+  return i ? head : 0;
+}
+
+// Refill the empty cache of the current CPU, first from kmem
+// and failing that from another CPU.  Returns one page, or 0
+// if all of memory is in use.  Called with interrupts off.
+static struct run*
+krefill(struct kcache *kc)
+{
+  struct kcache *victim;
+  struct run *chain;
+  int got;
+
+  acquire(&kmem.lock);
+  chain = ktake(&kmem.freelist, KBATCH, &got);
+  kmem.n -= got;
+  release(&kmem.lock);
+
+  for(victim = kcaches; chain == 0 && victim < &kcaches[NCPU]; victim++){
+    if(victim == kc)
+      continue;
+    acquire(&victim->lock);
+    chain = ktake(&victim->freelist, (victim->n + 1) / 2, &got);
+    victim->n -= got;
+    release(&victim->lock);
+  }
+  if(chain == 0)
+    return 0;
+
+  // Other CPUs only take from kc, so it is still empty.
+  if(got > 1){
+    acquire(&kc->lock);
+    kc->freelist = chain->next;
+    kc->n = got - 1;
+    release(&kc->lock);
+  }
+  return chain;
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -59,21 +157,85 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *chain;
+  int got;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  // Drop one reference; only the last one frees the page.
+  if(fetchadd(&PAGEREF(v), -1) > 1)
+    return;
+  PAGEREF(v) = 0;
+
+#ifdef KALLOC_DEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.n++;
+    return;
+  }
+
+  pushcli();
+  kc = &kcaches[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  chain = 0;
+  if(++kc->n > KCACHE){
+    chain = ktake(&kc->freelist, KBATCH, &got);
+    kc->n -= got;
+  }
+  release(&kc->lock);
+  if(chain){
+    // Splice the drained batch onto the global list.
+    for(r = chain; r->next; r = r->next)
+      ;
+    acquire(&kmem.lock);
+    r->next = kmem.freelist;
+    kmem.freelist = chain;
+    kmem.n += got;
     release(&kmem.lock);
+  }
+  popcli();
+}
+
+// Allocate a page from the per-CPU caches and kmem, without
+// falling back on the kzero pool, which is what kzerod fills.
+static struct run*
+kallocfree(void)
+{
+  struct kcache *kc;
+  struct run *r;
+
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      kmem.n--;
+    }
+    return r;
+  }
+
+  pushcli();
+  kc = &kcaches[cpuid()];
+  acquire(&kc->lock);
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  if(r == 0)
+    r = krefill(kc);
+  popcli();
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -84,13 +246,102 @@ kalloc(void)
 {
   struct run *r;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
+  if((r = kallocfree()) == 0 && kmem.use_lock){
+    acquire(&kzero.lock);
+    if((r = kzero.freelist) != 0){
+      kzero.freelist = r->next;
+      kzero.n--;
+    }
+    if(kzero.n <= ZPOOL/2)
+      wakeup(&kzero);
+    release(&kzero.lock);
+  }
   if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+    PAGEREF(r) = 1;
   return (char*)r;
 }
 
+// Add a reference to the page v, which must be allocated.
+void
+kdup(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP || PAGEREF(v) < 1)
+    panic("kdup");
+  fetchadd(&PAGEREF(v), 1);
+}
+
+// Return the number of references to the page v.
+int
+krefs(char *v)
+{
+  return PAGEREF(v);
+}
+
+// Return the number of free pages, including kzerod's pool.
+// The count is only a snapshot: the lists are not locked.
+int
+kfreepages(void)
+{
+  int i, n;
+
+  n = kmem.n + kzero.n;
+  for(i = 0; i < NCPU; i++)
+    n += kcaches[i].n;
+  return n;
+}
+
+// Allocate one zeroed page, from kzerod's pool if it has one.
+char*
+kzalloc(void)
+{
+  struct run *r;
+  char *v;
+
+  r = 0;
+  if(kmem.use_lock){
+    acquire(&kzero.lock);
+    if((r = kzero.freelist) != 0){
+      kzero.freelist = r->next;
+      kzero.n--;
+    }
+    if(kzero.n <= ZPOOL/2)
+      wakeup(&kzero);
+    release(&kzero.lock);
+  }
+  if(r){
+    r->next = 0;
+    return (char*)r;
+  }
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Body of the kzerod kernel thread.
+void
+kzerod(void)
+{
+  char *v;
+
+  for(;;){
+    acquire(&kzero.lock);
+    while(kzero.n > ZPOOL/2)
+      sleep(&kzero, &kzero.lock);
+    while(kzero.n < ZPOOL){
+      release(&kzero.lock);
+      if((v = (char*)kallocfree()) == 0){
+        acquire(&kzero.lock);
+        break;
+      }
+      PAGEREF(v) = 1;
+      memset(v, 0, PGSIZE);
+      acquire(&kzero.lock);
+      ((struct run*)v)->next = kzero.freelist;
+      kzero.freelist = (struct run*)v;
+      kzero.n++;
+    }
+    // Out of memory or full: wait for the next wakeup.
+    sleep(&kzero, &kzero.lock);
+    release(&kzero.lock);
+  }
+}
@@ -0,0 +1,56 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define ROUNDS 200
+#define PAGES 64
+#define PGSIZE 4096
+
+// Grow and shrink the heap ROUNDS times by PAGES pages,
+// forking a short-lived child every few rounds.
+void worker(void)
+{
+  int i, j;
+  char *p;
+
+  for (i = 0; i < ROUNDS; i++)
+  {
+    if ((p = sbrk(PAGES * PGSIZE)) == (char *)-1)
+    {
+      printf(2, "kalloc_test: sbrk failed\n");
+      exit();
+    }
+    for (j = 0; j < PAGES; j++)
+      p[j * PGSIZE] = j;
+    sbrk(-PAGES * PGSIZE);
+    if (i % 8 == 0)
+    {
+      if (fork() == 0)
+        exit();
+      wait();
+    }
+  }
+  exit();
+}
+
+int main(int argc, char *argv[])
+{
+  int n, i, start, t, pages;
+
+  n = argc > 1 ? atoi(argv[1]) : 4;
+  if (n < 1)
+    n = 1;
+  start = uptime();
+  for (i = 0; i < n; i++)
+  {
+    if (fork() == 0)
+      worker();
+  }
+  for (i = 0; i < n; i++)
+    wait();
+  t = uptime() - start;
+  pages = n * ROUNDS * PAGES;
+  printf(1, "%d workers: %d pages in %d ticks, %d pages/s\n",
+         n, pages, t, t ? pages * 100 / t : 0);
+  exit();
+}
@@ -0,0 +1,87 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSPAWN 100
+#define NFORK 500
+#define HEAP (8 * 1024 * 1024)
+#define ROUNDS 16
+#define PGSIZE 4096
+
+void fail(char *msg)
+{
+  printf(2, "kvm_test: %s\n", msg);
+  exit();
+}
+
+// Each new process costs a page directory with the kernel
+// mapped in it, and each exit frees one.
+void spawnexit(void)
+{
+  char *args[] = {"kvm_test", "exit", 0};
+  int i, start, t;
+
+  start = uptime();
+  for (i = 0; i < NSPAWN; i++)
+  {
+    if (spawn("kvm_test", args, 0, 0) < 0)
+      fail("spawn failed");
+    wait();
+  }
+  t = uptime() - start;
+  printf(1, "spawn+exit+wait: %d in %d ticks, %d us each\n",
+         NSPAWN, t, t * 10000 / NSPAWN);
+}
+
+// A small process forking a child that exits at once: the
+// child's page directory is set up and freed each time.
+void forkexit(void)
+{
+  int i, start, t;
+
+  start = uptime();
+  for (i = 0; i < NFORK; i++)
+  {
+    if (fork() == 0)
+      exit();
+    wait();
+  }
+  t = uptime() - start;
+  printf(1, "fork+exit+wait: %d in %d ticks, %d us each\n",
+         NFORK, t, t * 10000 / NFORK);
+}
+
+// Fault in a fresh heap page by page: the kernel zeroes and
+// maps each one through its direct map of physical memory,
+// touching a new page of it every time.
+void heapfill(void)
+{
+  int i, j, start, t;
+  char *p;
+
+  start = uptime();
+  for (i = 0; i < ROUNDS; i++)
+  {
+    if ((p = sbrk(HEAP)) == (char *)-1)
+      fail("sbrk failed");
+    for (j = 0; j < HEAP; j += PGSIZE)
+      p[j] = 1;
+    sbrk(-HEAP);
+  }
+  t = uptime() - start;
+  if (t == 0)
+    t = 1;
+  printf(1, "heap fill: %d MB in %d ticks, %d MB/s\n",
+         ROUNDS * HEAP / (1024 * 1024), t,
+         ROUNDS * HEAP / (1024 * 1024) * 100 / t);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1)
+    exit();
+  forkexit();
+  spawnexit();
+  heapfill();
+  exit();
+}
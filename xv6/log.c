@@ -65,19 +65,35 @@ initlog(int dev)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location,
+// a batch of blocks at a time.
 static void
 install_trans(void)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+  int tail, i, k, nd;
+  uint blocknos[NIODEPTH];
+  struct buf *lbufs[NIODEPTH], *dbufs[NIODEPTH];
+
+  for (tail = 0; tail < log.lh.n; tail += k) {
+    k = log.lh.n - tail;
+    if (k > NIODEPTH)
+      k = NIODEPTH;
+    for (i = 0; i < k; i++)
+      blocknos[i] = log.start+tail+i+1;
+    k = breadv(log.dev, blocknos, k, lbufs); // read log blocks
+    for (i = 0; i < k; i++)
+      blocknos[i] = log.lh.block[tail+i];
+    nd = breadv(log.dev, blocknos, k, dbufs); // read dsts
+    for (i = nd; i < k; i++)
+      brelse(lbufs[i]);
+    k = nd;
+    for (i = 0; i < k; i++)
+      memmove(dbufs[i]->data, lbufs[i]->data, BSIZE);  // copy block to dst
+    bwritev(dbufs, k);  // write dsts to disk
+    for (i = 0; i < k; i++) {
+      brelse(lbufs[i]);
+      brelse(dbufs[i]);
+    }
   }
 }
 
@@ -173,19 +189,34 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log, a batch at a time.
 static void
 write_log(void)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  int tail, i, k, nf;
+  uint blocknos[NIODEPTH];
+  struct buf *to[NIODEPTH], *from[NIODEPTH];
+
+  for (tail = 0; tail < log.lh.n; tail += k) {
+    k = log.lh.n - tail;
+    if (k > NIODEPTH)
+      k = NIODEPTH;
+    for (i = 0; i < k; i++)
+      blocknos[i] = log.start+tail+i+1;
+    k = breadv(log.dev, blocknos, k, to); // log blocks
+    for (i = 0; i < k; i++)
+      blocknos[i] = log.lh.block[tail+i];
+    nf = breadv(log.dev, blocknos, k, from); // cache blocks
+    for (i = nf; i < k; i++)
+      brelse(to[i]);
+    k = nf;
+    for (i = 0; i < k; i++)
+      memmove(to[i]->data, from[i]->data, BSIZE);
+    bwritev(to, k);  // write the log
+    for (i = 0; i < k; i++) {
+      brelse(from[i]);
+      brelse(to[i]);
+    }
   }
 }
 
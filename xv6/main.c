@@ -29,11 +29,17 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  slabinit();      // object caches
   fileinit();      // file table
+  pipeinit();      // pipe cache
+  prioritylockinit(); // priority lock waiters
+  textinit();      // shared program pages
+  shmeminit();     // shared memory segments
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
+  kthread("kzerod", kzerod);  // page-zeroing thread
   mpmain();        // finish this processor's setup
 }
 
@@ -0,0 +1,82 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NDIRS 100
+#define NPERDIR 100  // NDIRS * NPERDIR = 10000 files
+
+char name[16];
+
+// Set name to "dNN" or "dNN/fNN".
+void mkname(int d, int f)
+{
+  name[0] = 'd';
+  name[1] = '0' + d / 10;
+  name[2] = '0' + d % 10;
+  name[3] = 0;
+  if (f >= 0)
+  {
+    name[3] = '/';
+    name[4] = 'f';
+    name[5] = '0' + f / 10;
+    name[6] = '0' + f % 10;
+    name[7] = 0;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int d, f, fd, start, lap;
+
+  // Creation time per 1000 files should stay flat as the
+  // inode table fills.
+  start = lap = uptime();
+  for (d = 0; d < NDIRS; d++)
+  {
+    mkname(d, -1);
+    if (mkdir(name) < 0)
+    {
+      printf(2, "manyfiles_test: mkdir %s failed\n", name);
+      exit();
+    }
+    for (f = 0; f < NPERDIR; f++)
+    {
+      mkname(d, f);
+      if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+      {
+        printf(2, "manyfiles_test: cannot create %s\n", name);
+        exit();
+      }
+      close(fd);
+    }
+    if ((d + 1) % 10 == 0)
+    {
+      printf(1, "files %d-%d: %d ticks\n", d * NPERDIR - 900, (d + 1) * NPERDIR - 1, uptime() - lap);
+      lap = uptime();
+    }
+  }
+  printf(1, "created %d files in %d ticks\n", NDIRS * NPERDIR, uptime() - start);
+
+  start = uptime();
+  for (d = 0; d < NDIRS; d++)
+  {
+    for (f = 0; f < NPERDIR; f++)
+    {
+      mkname(d, f);
+      if (unlink(name) < 0)
+      {
+        printf(2, "manyfiles_test: unlink %s failed\n", name);
+        exit();
+      }
+    }
+    mkname(d, -1);
+    if (unlink(name) < 0)
+    {
+      printf(2, "manyfiles_test: unlink %s failed\n", name);
+      exit();
+    }
+  }
+  printf(1, "removed %d files in %d ticks\n", NDIRS * NPERDIR, uptime() - start);
+  exit();
+}
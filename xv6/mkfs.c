@@ -15,8 +15,6 @@
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 200
-
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
@@ -39,7 +37,9 @@ void winode(uint, struct dinode*);
 void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
+uint ibmap(struct dinode *din, uint fbn);
 void iappend(uint inum, void *p, int n);
+void dirappend(uint inum, struct dirent *de);
 
 // convert to intel byte order
 ushort
@@ -83,6 +83,7 @@ main(int argc, char *argv[])
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
+  assert(sizeof(struct dirindex) == BSIZE);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
@@ -91,7 +92,7 @@ main(int argc, char *argv[])
   }
 
   // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
+  nmeta = 2 + nlog + ninodeblocks + 2*nbitmap;
   nblocks = FSSIZE - nmeta;
 
   sb.size = xint(FSSIZE);
@@ -101,9 +102,10 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.smapstart = xint(2+nlog+ninodeblocks+nbitmap);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u, share map blocks %u) blocks %d total %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nbitmap, nblocks, FSSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
@@ -147,7 +149,7 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, &de);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -158,7 +160,7 @@ main(int argc, char *argv[])
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
+  off = ((off + BSIZE - 1)/BSIZE) * BSIZE;
   din.size = xint(off);
   winode(rootino, &din);
 
@@ -252,6 +254,50 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the sector of block fbn of inode din, allocating it
+// and any indirect blocks if necessary.
+uint
+ibmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint x, ind;
+
+  assert(fbn < MAXFILE);
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0){
+      din->addrs[fbn] = xint(freeblock++);
+    }
+    x = xint(din->addrs[fbn]);
+  } else if(fbn < NDIRECT + NINDIRECT){
+    if(xint(din->addrs[NDIRECT]) == 0){
+      din->addrs[NDIRECT] = xint(freeblock++);
+    }
+    rsect(xint(din->addrs[NDIRECT]), (char*)indirect);
+    if(indirect[fbn - NDIRECT] == 0){
+      indirect[fbn - NDIRECT] = xint(freeblock++);
+      wsect(xint(din->addrs[NDIRECT]), (char*)indirect);
+    }
+    x = xint(indirect[fbn-NDIRECT]);
+  } else {
+    if(xint(din->addrs[NDIRECT+1]) == 0){
+      din->addrs[NDIRECT+1] = xint(freeblock++);
+    }
+    rsect(xint(din->addrs[NDIRECT+1]), (char*)indirect);
+    if(indirect[(fbn - NDIRECT - NINDIRECT) / NINDIRECT] == 0){
+      indirect[(fbn - NDIRECT - NINDIRECT) / NINDIRECT] = xint(freeblock++);
+      wsect(xint(din->addrs[NDIRECT+1]), (char*)indirect);
+    }
+    ind = xint(indirect[(fbn - NDIRECT - NINDIRECT) / NINDIRECT]);
+    rsect(ind, (char*)indirect);
+    if(indirect[(fbn - NDIRECT - NINDIRECT) % NINDIRECT] == 0){
+      indirect[(fbn - NDIRECT - NINDIRECT) % NINDIRECT] = xint(freeblock++);
+      wsect(ind, (char*)indirect);
+    }
+    x = xint(indirect[(fbn - NDIRECT - NINDIRECT) % NINDIRECT]);
+  }
+  return x;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -259,7 +305,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -267,23 +312,7 @@ iappend(uint inum, void *xp, int n)
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = ibmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -295,3 +324,67 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Add entry de to directory inum the way the kernel's dirlink()
+// does: append until the first block is full, then hash.
+void
+dirappend(uint inum, struct dirent *de)
+{
+  struct dinode din;
+  struct dirindex idx;
+  struct dirent des[BSIZE/sizeof(struct dirent)];
+  uint h, bn, x, size;
+  int i;
+
+  rinode(inum, &din);
+  size = xint(din.size);
+  if(xint(din.hashblk) == 0 && (size < BSIZE || size % BSIZE != 0)){
+    iappend(inum, de, sizeof(*de));
+    return;
+  }
+  if(xint(din.hashblk) == 0){
+    din.hashblk = xint(freeblock++);
+    bzero(&idx, sizeof(idx));
+    idx.nlinear = xshort(size / BSIZE);
+    wsect(xint(din.hashblk), &idx);
+  }
+  rsect(xint(din.hashblk), &idx);
+
+  h = dirhash(de->name);
+  for(bn = xshort(idx.head[h]); bn != 0; bn = xshort(idx.next[bn])){
+    x = ibmap(&din, bn);
+    rsect(x, des);
+    for(i = 0; i < BSIZE/sizeof(struct dirent); i++){
+      if(des[i].inum == 0){
+        des[i] = *de;
+        wsect(x, des);
+        winode(inum, &din);
+        return;
+      }
+    }
+  }
+
+  bn = size / BSIZE;
+  assert(bn < NDCHAIN);
+  x = ibmap(&din, bn);
+  bzero(des, sizeof(des));
+  des[0] = *de;
+  wsect(x, des);
+  idx.next[bn] = idx.head[h];
+  idx.head[h] = xshort(bn);
+  wsect(xint(din.hashblk), &idx);
+  din.size = xint((bn+1)*BSIZE);
+  winode(inum, &din);
+}
@@ -0,0 +1,8 @@
+// Protection and sharing flags for mmap().
+#define PROT_READ    0x1  // pages may be read
+#define PROT_WRITE   0x2  // pages may be written
+
+#define MAP_SHARED   0x1  // writes go back to the file
+#define MAP_PRIVATE  0x2  // writes stay in this process
+
+#define MAP_FAILED   ((void*)-1)  // mmap() error return
@@ -0,0 +1,354 @@
+//
+// Memory-mapped files.
+//
+// mmap() only reserves addresses above MMAPBASE and records them
+// in the process's vma table.  A page is allocated the first time
+// the process touches it, when mmapfault() reads it from the file
+// through the buffer cache.  Pages of a MAP_SHARED mapping that
+// the hardware has marked dirty are written back through the log
+// by msync(), munmap(), exec() and exit(); MAP_PRIVATE pages never
+// go back to the file.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "mman.h"
+
+// Return the region of p that contains va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->f && va >= v->addr && va - v->addr < v->len)
+      return v;
+  return 0;
+}
+
+static struct vma*
+freevma(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++)
+    if(v->f == 0)
+      return v;
+  return 0;
+}
+
+// Find len free bytes of address space between MMAPBASE
+// and SHMBASE.  Returns 0 if there is no room.
+static uint
+findspace(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  a = MMAPBASE;
+again:
+  if(len > SHMBASE - a)
+    return 0;
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->f && a < v->addr + v->len && v->addr < a + len){
+      a = v->addr + v->len;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Map len bytes of f starting at offset off.
+// Returns the address of the mapping, or -1.
+int
+mmapfile(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint a;
+
+  if(len == 0 || len > SHMBASE - MMAPBASE || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(f->type != FD_INODE || !f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type != T_FILE){
+    iunlock(f->ip);
+    return -1;
+  }
+  iunlock(f->ip);
+
+  len = PGROUNDUP(len);
+  if((v = freevma(p)) == 0 || (a = findspace(p, len)) == 0)
+    return -1;
+  v->addr = a;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = filedup(f);
+  return a;
+}
+
+// Read in the page holding va after a fault.
+// Returns 0 if va lies in a mapping that allows the access.
+int
+mmapfault(uint va, int write)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  struct inode *ip;
+  pte_t *pte;
+  char *mem;
+  uint off;
+  int perm;
+
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  if(write && !(v->prot & PROT_WRITE))
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P))
+    return -1;
+
+  if((mem = kzalloc()) == 0)
+    return -1;
+  off = v->off + (va - v->addr);
+  ip = v->f->ip;
+  ilock(ip);
+  if(off < ip->size)
+    readi(ip, mem, off, PGSIZE);
+  iunlock(ip);
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Check that a system call buffer [va, va+n) lies in one
+// writable mapping and fault all of it in now, so that the
+// kernel never takes a page fault on it.  Read-only mappings
+// are refused: the kernel runs with CR0.WP set and cannot tell
+// here whether it will read the buffer or write it.
+int
+mmapuser(uint va, uint n)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  if((v = findvma(p, va)) == 0 || !(v->prot & PROT_WRITE))
+    return -1;
+  if(n > v->addr + v->len - va)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if((pte == 0 || !(*pte & PTE_P)) && mmapfault(a, 1) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Write the page at va back to the file of v if it is shared
+// and dirty.  Only the part of the page inside the file is
+// written, so a mapping never grows its file.  The caller must
+// flush the TLB afterwards, or the CPU will not mark the page
+// dirty again.
+static int
+vmaflush(struct vma *v, uint va, pte_t *pte)
+{
+  struct inode *ip;
+  uint off, size, n;
+
+  if(v->flags != MAP_SHARED || !(*pte & PTE_D))
+    return 0;
+  *pte &= ~PTE_D;
+  off = v->off + (va - v->addr);
+  ip = v->f->ip;
+  ilock(ip);
+  size = ip->size;
+  iunlock(ip);
+  if(off >= size)
+    return 0;
+  n = size - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  if(filepwrite(v->f, P2V(PTE_ADDR(*pte)), n, off) != n)
+    return -1;
+  return 0;
+}
+
+// Write back and free the pages of v in [addr, addr+len).
+static int
+vmaunmap(struct proc *p, struct vma *v, uint addr, uint len)
+{
+  pte_t *pte;
+  uint a;
+  int r;
+
+  r = 0;
+  for(a = addr; a < addr + len; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    if(vmaflush(v, a, pte) < 0)
+      r = -1;
+    kfree(P2V(PTE_ADDR(*pte)));
+    *pte = 0;
+  }
+  lcr3(V2P(p->pgdir));
+  return r;
+}
+
+// Unmap [addr, addr+len), which must lie inside one mapping.
+// Unmapping the middle of a mapping splits it in two.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint end;
+  int r;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  if((v = findvma(p, addr)) == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if(len == 0 || len > v->addr + v->len - addr)
+    return -1;
+  end = v->addr + v->len;
+  if(addr > v->addr && addr + len < end){
+    if((nv = freevma(p)) == 0)
+      return -1;
+    *nv = *v;
+    nv->addr = addr + len;
+    nv->len = end - nv->addr;
+    nv->off = v->off + (nv->addr - v->addr);
+    filedup(nv->f);
+    v->len = addr + len - v->addr;
+  }
+
+  r = vmaunmap(p, v, addr, len);
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0){
+    fileclose(v->f);
+    v->f = 0;
+  }
+  return r;
+}
+
+// Write back the dirty shared pages in [addr, addr+len),
+// which must lie inside one mapping.
+int
+msync(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+  int r;
+
+  if(addr % PGSIZE != 0 || (v = findvma(p, addr)) == 0)
+    return -1;
+  if(len > v->addr + v->len - addr)
+    return -1;
+  r = 0;
+  for(a = addr; a < addr + len; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    if(vmaflush(v, a, pte) < 0)
+      r = -1;
+  }
+  lcr3(V2P(p->pgdir));
+  return r;
+}
+
+// Unmap every region of the current process, writing back
+// dirty shared pages.  Called by exec() and exit().
+void
+munmapall(void)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->f == 0)
+      continue;
+    vmaunmap(p, v, v->addr, v->len);
+    fileclose(v->f);
+    v->f = 0;
+  }
+}
+
+// Give child np every region of p, including the pages p has
+// already faulted in: the child maps the same pages of a
+// MAP_SHARED region and gets copies of those of a MAP_PRIVATE
+// one.  On failure the child's regions are released, but not
+// its page table.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  struct vma *v, *nv;
+  pte_t *pte;
+  char *mem;
+  uint a;
+
+  for(v = p->vma; v < &p->vma[NMMAP]; v++){
+    if(v->f == 0)
+      continue;
+    nv = &np->vma[v - p->vma];
+    *nv = *v;
+    filedup(nv->f);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || !(*pte & PTE_P))
+        continue;
+      if(v->flags == MAP_SHARED){
+        mem = P2V(PTE_ADDR(*pte));
+        kdup(mem);
+      } else {
+        if((mem = kalloc()) == 0)
+          goto bad;
+        memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+      }
+      if(mappages(np->pgdir, (char*)a, PGSIZE, V2P(mem), PTE_FLAGS(*pte)) < 0){
+        kfree(mem);
+        goto bad;
+      }
+    }
+  }
+  return 0;
+
+bad:
+  for(nv = np->vma; nv < &np->vma[NMMAP]; nv++){
+    if(nv->f){
+      fileclose(nv->f);
+      nv->f = 0;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,168 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define FILENAME "mmap.tmp"
+#define FILESIZE (1024 * 1024)
+#define LINE "the quick brown fox jumps over the lazy dog\n"
+
+char buf[8192];
+int lines;
+
+void fail(char *msg)
+{
+  printf(2, "mmap_test: %s\n", msg);
+  unlink(FILENAME);
+  exit();
+}
+
+// Count lines the way wc does.
+void count(char *p, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (p[i] == '\n')
+      lines++;
+}
+
+void makefile(void)
+{
+  int fd, i, n;
+
+  n = strlen(LINE);
+  for (i = 0; i + n <= sizeof(buf); i += n)
+    memmove(buf + i, LINE, n);
+  for (; i < sizeof(buf); i++)
+    buf[i] = '\n';
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+    fail("cannot create file");
+  for (i = 0; i < FILESIZE / sizeof(buf); i++)
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write failed");
+  close(fd);
+}
+
+// Scan the file with read() calls of size n.
+int scanread(int n)
+{
+  int fd, r, start;
+
+  lines = 0;
+  start = uptime();
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  while ((r = read(fd, buf, n)) > 0)
+    count(buf, r);
+  close(fd);
+  printf(1, "read %d: %d lines in %d ticks, syscalls:\n", n, lines, uptime() - start);
+  print_cpu_syscalls_count();
+  return lines;
+}
+
+// Scan the file through a mapping.
+int scanmap(void)
+{
+  int fd, start;
+  char *p;
+
+  lines = 0;
+  start = uptime();
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  if ((p = mmap(0, FILESIZE, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    fail("mmap failed");
+  close(fd);
+  count(p, FILESIZE);
+  if (munmap(p, FILESIZE) < 0)
+    fail("munmap failed");
+  printf(1, "mmap: %d lines in %d ticks, syscalls:\n", lines, uptime() - start);
+  print_cpu_syscalls_count();
+  return lines;
+}
+
+// Private writes stay in memory; shared ones reach the file.
+void checkwrites(void)
+{
+  int fd;
+  char *p, c;
+
+  if ((fd = open(FILENAME, O_RDWR)) < 0)
+    fail("cannot open file");
+
+  if ((p = mmap(0, FILESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    fail("private mmap failed");
+  p[4096] = 'P';
+  munmap(p, FILESIZE);
+  if (pread(fd, &c, 1, 4096) != 1 || c == 'P')
+    fail("private write reached the file");
+
+  if ((p = mmap(0, FILESIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    fail("shared mmap failed");
+  p[8192] = 'S';
+  if (msync(p, FILESIZE) < 0)
+    fail("msync failed");
+  if (pread(fd, &c, 1, 8192) != 1 || c != 'S')
+    fail("msync did not write the page back");
+  p[8193] = 'U';
+  munmap(p, FILESIZE);
+  if (pread(fd, &c, 1, 8193) != 1 || c != 'U')
+    fail("munmap did not write the page back");
+  close(fd);
+  printf(1, "private and shared writes ok\n");
+}
+
+// Unmap a hole, pass a mapped buffer to write(), and fork:
+// the child shares the pages of the MAP_SHARED mapping.
+void checkmisc(void)
+{
+  int fd, pid;
+  char *p, c;
+
+  if ((fd = open(FILENAME, O_RDWR)) < 0)
+    fail("cannot open file");
+  if ((p = mmap(0, FILESIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    fail("mmap failed");
+  if (munmap(p + 4096, 4096) < 0)
+    fail("munmap of a hole failed");
+  if (p[0] != 't' || p[8192] != 'S')
+    fail("pages around the hole are wrong");
+
+  if (pwrite(fd, p + 8192, 1, 0) != 1 || pread(fd, &c, 1, 0) != 1 || c != 'S')
+    fail("write from a mapped buffer failed");
+
+  pid = fork();
+  if (pid < 0)
+    fail("fork failed");
+  if (pid == 0)
+  {
+    if (p[8192] != 'S' || p[FILESIZE - 1] != '\n')
+      printf(2, "mmap_test: child sees the wrong data\n");
+    p[8193] = 'C';
+    exit();
+  }
+  wait();
+  if (p[8193] != 'C')
+    fail("parent does not see the child's shared write");
+  munmap(p, 4096);
+  munmap(p + 8192, FILESIZE - 8192);
+  close(fd);
+  printf(1, "hole, buffer and fork ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int n;
+
+  makefile();
+  print_cpu_syscalls_count();
+  n = scanread(512);
+  if (scanread(sizeof(buf)) != n || scanmap() != n)
+    fail("line counts differ");
+  checkwrites();
+  checkmisc();
+  unlink(FILENAME);
+  exit();
+}
@@ -3,12 +3,20 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // i-nodes cached at boot
+#define MAXINODE   2048  // most i-nodes cached, grown from kalloc
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define NIODEPTH     8  // max disk requests one batch keeps in flight
+#define NREADAHEAD   8  // max blocks read ahead of a sequential reader
+#define NDCACHE     512  // cached directory entries, including negative ones
+#define NMMAP        16  // memory-mapped regions per process
+#define NEXECSEG      2  // loadable ELF segments per program
+#define NSHMEM       16  // shared memory segments, and per process
+#define NINODES      12288  // number of inodes in the file system
+#define FSSIZE       (20*1024*1024/BSIZE)  // size of file system in blocks (20 MB)
 
@@ -2,23 +2,56 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "x86.h"
 #include "proc.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define MAXPIPEPAGES 16  // largest pipe buffer, in pages; a power of two
+#define MINPIPESPIN  64  // shortest spin before sleeping
+#define MAXPIPESPIN  4096  // longest spin before sleeping
 
+// struct pipe comes from pipecache, and its buffer is one page
+// to start with.  fcntl(F_SETPIPE_SZ) can move it to up to
+// MAXPIPEPAGES separate pages, which need not be contiguous.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rwait;      // readers asleep on nread
+  int wwait;      // writers asleep on nwrite
+  struct proc *reader;  // last process to read, a hint
+  struct proc *writer;  // last process to write, a hint
+  int spin;       // current spin length, in pause loops
+  uint size;      // capacity of the buffer in bytes
+  int npages;     // pages in the buffer
+  char *pages[MAXPIPEPAGES];
 };
 
+static struct kmem_cache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = kmem_cache_create("pipe", sizeof(struct pipe));
+}
+
+// Return the buffer address of byte i of the pipe's stream and,
+// in *len, how many bytes from there are contiguous.  nread and
+// nwrite wrap around at 2^32, which the buffer size must divide,
+// so it is always a power-of-two number of pages.
+static char*
+pipebuf(struct pipe *p, uint i, uint *len)
+{
+  i %= p->size;
+  *len = PGSIZE - i % PGSIZE;
+  return p->pages[i / PGSIZE] + i % PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,12 +61,22 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = kmem_cache_alloc(pipecache)) == 0)
     goto bad;
+  if((p->pages[0] = kalloc()) == 0){
+    kmem_cache_free(pipecache, p);
+    p = 0;
+    goto bad;
+  }
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->rwait = p->wwait = 0;
+  p->reader = p->writer = 0;
+  p->spin = MINPIPESPIN;
+  p->size = PGSIZE;
+  p->npages = 1;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -47,8 +90,10 @@ pipealloc(struct file **f0, struct file **f1)
 
 //PAGEBREAK: 20
  bad:
-  if(p)
-    kfree((char*)p);
+  if(p){
+    kfree(p->pages[0]);
+    kmem_cache_free(pipecache, p);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,53 +114,231 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    while(p->npages > 0)
+      kfree(p->pages[--p->npages]);
+    kmem_cache_free(pipecache, p);
   } else
     release(&p->lock);
 }
 
+// If peer is running on another CPU, it may move *ctr away from
+// old soon, so spin for that with p->lock released instead of
+// going to sleep and waiting for a wakeup.  The spin grows while
+// it pays off and shrinks while it does not.  Returns 1 if *ctr
+// moved.  Caller holds p->lock, and holds it again on return.
+static int
+pipespin(struct pipe *p, struct proc *peer, uint *ctr, uint old)
+{
+  int i, spin;
+
+  if(ncpu < 2 || peer == 0 || peer == myproc() || peer->state != RUNNING)
+    return 0;
+  spin = p->spin;
+  release(&p->lock);
+  for(i = 0; i < spin && *(volatile uint*)ctr == old; i++)
+    pause();
+  acquire(&p->lock);
+  if(*ctr != old){
+    if(p->spin < MAXPIPESPIN)
+      p->spin *= 2;
+    return 1;
+  }
+  if(p->spin > MINPIPESPIN)
+    p->spin /= 2;
+  return 0;
+}
+
+// Wakeups are batched: a sleeping reader is woken when the buffer
+// fills or the write ends, and a sleeping writer only once half
+// the buffer is free, rather than on every call.  wakeup() scans
+// the whole process table, so it is skipped when nobody sleeps.
 //PAGEBREAK: 40
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
   int i;
+  uint m, len;
+  char *dst;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  p->writer = myproc();
+  for(i = 0; i < n; i += m){
+    while(p->nwrite == p->nread + p->size){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if(p->rwait)
+        wakeup(&p->nread);
+      if(pipespin(p, p->reader, &p->nread, p->nread))
+        continue;
+      p->wwait++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->wwait--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    dst = pipebuf(p, p->nwrite, &len);
+    m = p->nread + p->size - p->nwrite;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    memmove(dst, addr + i, m);
+    p->nwrite += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  if(p->rwait)
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Wait until p has room and return how many bytes it can take,
+// or -1 if its read end is closed or the caller is killed.  For
+// a writer that must not hold p->lock while fetching its data,
+// which then hands the data to pipeput().
+int
+pipewait(struct pipe *p)
+{
+  int n;
+
+  acquire(&p->lock);
+  p->writer = myproc();
+  while(p->nwrite == p->nread + p->size){
+    if(p->readopen == 0 || myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    if(p->rwait)
+      wakeup(&p->nread);
+    if(pipespin(p, p->reader, &p->nread, p->nread))
+      continue;
+    p->wwait++;
+    sleep(&p->nwrite, &p->lock);
+    p->wwait--;
+  }
+  n = p->nread + p->size - p->nwrite;
+  release(&p->lock);
+  return n;
+}
+
+// Copy up to n bytes from addr into p without sleeping, and
+// return how many fitted, or -1 if the read end is closed.
+int
+pipeput(struct pipe *p, char *addr, int n)
+{
+  int i;
+  uint m, len;
+  char *dst;
+
+  acquire(&p->lock);
+  if(p->readopen == 0){
+    release(&p->lock);
+    return -1;
+  }
+  for(i = 0; i < n && p->nwrite != p->nread + p->size; i += m){
+    dst = pipebuf(p, p->nwrite, &len);
+    m = p->nread + p->size - p->nwrite;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    memmove(dst, addr + i, m);
+    p->nwrite += m;
+  }
+  if(p->rwait)
+    wakeup(&p->nread);
+  release(&p->lock);
+  return i;
+}
+
 int
 piperead(struct pipe *p, char *addr, int n)
 {
   int i;
+  uint m, len;
+  char *src;
 
   acquire(&p->lock);
+  p->reader = myproc();
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&p->lock);
       return -1;
     }
+    if(pipespin(p, p->writer, &p->nwrite, p->nwrite))
+      continue;
+    p->rwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->rwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    src = pipebuf(p, p->nread, &len);
+    m = p->nwrite - p->nread;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    memmove(addr + i, src, m);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  if(p->wwait && p->nwrite - p->nread <= p->size / 2)
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
+
+// Resize the buffer of p to hold at least n bytes, keeping what
+// is in it, and return the new capacity, n rounded up to a power
+// of two pages.
+// If n is 0, just return the capacity.  Fails if n is too large
+// or smaller than the data now in the pipe.
+int
+pipesize(struct pipe *p, int n)
+{
+  char *pages[MAXPIPEPAGES];
+  int npages, i;
+  uint cnt, m, len, size;
+  char *src;
+
+  if(n < 0 || n > MAXPIPEPAGES*PGSIZE)
+    return -1;
+  if(n == 0)
+    return p->size;
+  for(npages = 1; npages * PGSIZE < n; npages *= 2)
+    ;
+  size = npages * PGSIZE;
+  for(i = 0; i < npages; i++){
+    if((pages[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(pages[i]);
+      return -1;
+    }
+  }
+
+  acquire(&p->lock);
+  cnt = p->nwrite - p->nread;
+  if(cnt > size){
+    release(&p->lock);
+    for(i = 0; i < npages; i++)
+      kfree(pages[i]);
+    return -1;
+  }
+  // Copy the data to the front of the new buffer.
+  for(i = 0; i < cnt; i += m){
+    src = pipebuf(p, p->nread + i, &len);
+    m = cnt - i < len ? cnt - i : len;
+    if(m > PGSIZE - i % PGSIZE)
+      m = PGSIZE - i % PGSIZE;
+    memmove(pages[i / PGSIZE] + i % PGSIZE, src, m);
+  }
+  for(i = 0; i < p->npages; i++)
+    kfree(p->pages[i]);
+  for(i = 0; i < npages; i++)
+    p->pages[i] = pages[i];
+  p->npages = npages;
+  p->size = size;
+  p->nread = 0;
+  p->nwrite = cnt;
+  wakeup(&p->nwrite);
+  release(&p->lock);
+  return size;
+}
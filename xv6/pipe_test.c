@@ -0,0 +1,82 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define ROUNDS 2000
+#define BULK (4 * 1024 * 1024)
+
+char buf[8192];
+
+void fail(char *msg)
+{
+  printf(2, "pipe_test: %s\n", msg);
+  exit();
+}
+
+// Bounce one byte between two processes ROUNDS times.
+void pingpong(void)
+{
+  int ping[2], pong[2], i, sw, start, t;
+  char c;
+
+  if (pipe(ping) < 0 || pipe(pong) < 0)
+    fail("pipe failed");
+  sw = context_switches();
+  start = uptime();
+  if (fork() == 0)
+  {
+    for (i = 0; i < ROUNDS; i++)
+      if (read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        fail("child ping-pong failed");
+    exit();
+  }
+  for (i = 0; i < ROUNDS; i++)
+    if (write(ping[1], "x", 1) != 1 || read(pong[0], &c, 1) != 1)
+      fail("parent ping-pong failed");
+  wait();
+  t = uptime() - start;
+  sw = context_switches() - sw;
+  printf(1, "ping-pong: %d round trips in %d ticks, %d switches\n", ROUNDS, t, sw);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+}
+
+// Stream BULK bytes from a child in 8 KB writes.
+void bulk(void)
+{
+  int fds[2], i, n, total, sw, start, t;
+
+  if (pipe(fds) < 0)
+    fail("pipe failed");
+  sw = context_switches();
+  start = uptime();
+  if (fork() == 0)
+  {
+    close(fds[0]);
+    for (i = 0; i < BULK / sizeof(buf); i++)
+      if (write(fds[1], buf, sizeof(buf)) != sizeof(buf))
+        fail("bulk write failed");
+    exit();
+  }
+  close(fds[1]);
+  total = 0;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+    total += n;
+  close(fds[0]);
+  wait();
+  t = uptime() - start;
+  sw = context_switches() - sw;
+  if (total != BULK)
+    fail("bulk read lost data");
+  printf(1, "bulk: 4 MB in %d ticks, %d KB/s, %d switches/MB\n",
+         t, t ? 4 * 1024 * 100 / t : 0, sw / 4);
+}
+
+int main(int argc, char *argv[])
+{
+  pingpong();
+  bulk();
+  exit();
+}
@@ -7,6 +7,15 @@
 #include "proc.h"
 #include "prioritylock.h"
 
+// Waiter nodes are a few bytes each, so they come from a cache
+// rather than a page apiece.
+static struct kmem_cache *nodecache;
+
+void prioritylockinit(void)
+{
+  nodecache = kmem_cache_create("prioritylock node", sizeof(struct node));
+}
+
 void initprioritylock(struct prioritylock *plk, char *name)
 {
   initlock(&plk->slk, "spin lock");
@@ -15,28 +24,19 @@ void initprioritylock(struct prioritylock *plk, char *name)
   plk->head = 0;
 }
 
+// Insert the current process, keeping the queue sorted by
+// priority, lowest first.
 void add_to_queue(struct prioritylock *plk)
 {
-  struct node* temp = (struct node *)kalloc();
+  struct node **pp;
+  struct node *temp = kmem_cache_alloc(nodecache);
+  if(temp == 0)
+    panic("add_to_queue");
   temp->priority = myproc()->pid;
-  temp->next = 0;
-  if(plk->head == 0)
-    plk->head = temp;
-  else
-  {
-    struct node* trace = plk->head;
-    while(trace != 0)
-    {
-      if(trace->next->priority > temp->priority)
-      {
-    cprintf("mmmmmmmm\n");
-        temp->next = trace->next;
-        trace->next = temp;
-        break;
-      } 
-      trace = trace->next;
-    }
-  }
+  for(pp = &plk->head; *pp != 0 && (*pp)->priority <= temp->priority; pp = &(*pp)->next)
+    ;
+  temp->next = *pp;
+  *pp = temp;
 }
 
 void print_queue(struct prioritylock *plk)
@@ -60,7 +60,7 @@ void remove_from_queue(struct prioritylock *plk)
   if (temp != 0 && temp->priority == plk->pid_locked)
   {
     plk->head = temp->next;
-    // kfree((char *)temp);
+    kmem_cache_free(nodecache, temp);
   }
   else
   {
@@ -69,8 +69,10 @@ void remove_from_queue(struct prioritylock *plk)
       prev = temp;
       temp = temp->next;
     }
+    if (temp == 0)
+      return;
     prev->next = temp->next;
-    // kfree((char *)temp);
+    kmem_cache_free(nodecache, temp);
   }
 }
 
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "spawn.h"
 #include "utils.c"
 
 struct
@@ -21,6 +22,7 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static int startchild(struct proc *np);
 
 static char *states[] = {
     [UNUSED] "unused",
@@ -169,8 +171,40 @@ void userinit(void)
   transfer_process_queue(p->pid, RR);
 }
 
+// First code run by a kernel thread.  A kernel thread never
+// returns to user space, so its trap frame holds only the
+// function to run.
+static void kthreadstart(void)
+{
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+  ((void (*)(void))myproc()->tf->eip)();
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn, which must not return.  It
+// is scheduled like a process in the lowest-priority queue.
+void kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if ((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kthread");
+  p->parent = initproc;
+  p->tf->eip = (uint)fn;
+  p->context->eip = (uint)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+  transfer_process_queue(p->pid, BJF);
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
+// Growing only moves sz: heapfault() allocates each new page
+// when it is first touched.
 int growproc(int n)
 {
   uint sz;
@@ -179,8 +213,9 @@ int growproc(int n)
   sz = curproc->sz;
   if (n > 0)
   {
-    if ((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if (n > MMAPBASE - sz)
       return -1;
+    sz += n;
   }
   else if (n < 0)
   {
@@ -197,7 +232,7 @@ int growproc(int n)
 // Caller must set state of returned proc to RUNNABLE.
 int fork(void)
 {
-  int i, pid;
+  int i;
   struct proc *np;
   struct proc *curproc = myproc();
 
@@ -207,30 +242,56 @@ int fork(void)
     return -1;
   }
 
-  // Copy process state from proc.
-  if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0)
+  // Copy process state from proc.  copyuvm() made the parent's
+  // pages read-only, so flush its stale writable TLB entries.
+  np->pgdir = copyuvm(curproc->pgdir, curproc->sz);
+  lcr3(V2P(curproc->pgdir));
+  if (np->pgdir == 0)
   {
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
+  if (shmemfork(curproc, np) < 0 || mmapfork(curproc, np) < 0)
+  {
+    shmemrelease(np);
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->sz = curproc->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
 
-  // Added by me
-  np->generated_time = ticks / 100;
-
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
   for (i = 0; i < NOFILE; i++)
     if (curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+  if (curproc->exe)
+    np->exe = exedup(curproc->exe);
+  memmove(np->seg, curproc->seg, sizeof(curproc->seg));
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  return startchild(np);
+}
+
+// Make np, whose memory, trap frame and files are ready, a
+// runnable child of the current process.  Returns its pid.
+static int startchild(struct proc *np)
+{
+  struct proc *curproc = myproc();
+  int pid;
+
+  np->parent = curproc;
+
+  // Added by me
+  np->generated_time = ticks / 100;
+
+  np->cwd = idup(curproc->cwd);
   pid = np->pid;
 
   acquire(&ptable.lock);
@@ -250,6 +311,57 @@ int fork(void)
   return pid;
 }
 
+// Create a child running the program at path, as fork() followed
+// by exec() would, but without copying the caller's memory.  The
+// child gets copies of the caller's open files, changed by the
+// nact actions in act.  Returns the child's pid, or -1.
+int spawn(char *path, char **argv, struct spawnact *act, int nact)
+{
+  struct proc *np;
+  struct proc *curproc = myproc();
+  struct image img;
+  struct file *f;
+  int i;
+
+  if ((np = allocproc()) == 0)
+    return -1;
+  if (execload(path, argv, &img) < 0)
+  {
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  np->pgdir = img.pgdir;
+  np->sz = img.sz;
+  np->exe = img.exe;
+  memmove(np->seg, img.seg, sizeof(img.seg));
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->eip = img.eip;
+  np->tf->esp = img.sp;
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+
+  for (i = 0; i < NOFILE; i++)
+    if (curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  for (i = 0; i < nact; i++)
+  {
+    f = 0;
+    if (act[i].op == SPAWN_DUP && (f = np->ofile[act[i].src]) != 0)
+      filedup(f);
+    if (np->ofile[act[i].fd])
+      fileclose(np->ofile[act[i].fd]);
+    np->ofile[act[i].fd] = f;
+  }
+
+  setprocname(np, path);
+  return startchild(np);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -262,6 +374,10 @@ void exit(void)
   if (curproc == initproc)
     panic("init exiting");
 
+  // Write back and drop memory-mapped files.
+  munmapall();
+  shmemrelease(curproc);
+
   // Close all open files.
   for (fd = 0; fd < NOFILE; fd++)
   {
@@ -274,7 +390,10 @@ void exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if (curproc->exe)
+    exeput(curproc->exe);
   end_op();
+  curproc->exe = 0;
   curproc->cwd = 0;
 
   acquire(&ptable.lock);
@@ -451,6 +570,7 @@ void scheduler(void)
     
     p->mfq_info.last_exec_time = ticks;
     p->mfq_info.bjf.executed_cycle += 0.1f;
+    c->nswitch++;
 
     swtch(&(c->scheduler), p->context);
     switchkvm();
@@ -512,6 +632,8 @@ void forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    bfreeinit(ROOTDEV);
+    ifreeinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -11,6 +11,7 @@ struct cpu {
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
   uint syscall_counter;
+  uint nswitch;                // Switches into a process, for benchmarks
 };
 
 extern struct cpu cpus[NCPU];
@@ -61,6 +62,37 @@ struct MFQ_info  {
   int arrive_lcfs_queue_time;
 };
 
+// A memory-mapped region of a file, filled in page by page
+// as the process touches it.  Unused when f is 0.
+struct vma {
+  uint addr;                   // First mapped address, page-aligned
+  uint len;                    // Length in bytes, a multiple of PGSIZE
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // Mapped file
+  uint off;                    // File offset of addr
+};
+
+// A loadable ELF segment.  Its first filesz bytes are paged
+// in from the program file by execfault(); the rest of it is
+// zero-filled by heapfault() like the heap.
+struct execseg {
+  uint va;                     // First address, page-aligned
+  uint off;                    // File offset of va
+  uint filesz;                 // Bytes backed by the file
+};
+
+// A new address space built by execload(), for exec() or
+// spawn() to install in a process.
+struct image {
+  pde_t *pgdir;
+  uint sz;
+  uint eip;                    // Entry point
+  uint sp;                     // Stack pointer, with argv pushed
+  struct inode *exe;
+  struct execseg seg[NEXECSEG];
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -80,6 +112,10 @@ struct proc {
   char name[16];               // Process name (debugging)
   uint generated_time;         // Added by me.
   struct MFQ_info  mfq_info;   // scheduling information of mfq algorithm
+  struct vma vma[NMMAP];       // Memory-mapped files
+  struct inode *exe;           // Program file, paged in on demand
+  struct execseg seg[NEXECSEG]; // Its loadable segments
+  struct shpage *shmemtable[NSHMEM]; // Attached shared memory
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -87,6 +123,7 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// and, from MMAPBASE up, any memory-mapped files.
 
 int uncle_count(int pid);
 int process_lifetime(int pid);
@@ -0,0 +1,121 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "fs.h"
+
+#define FILENAME "readahead.tmp"
+#define NBLOCKS (4 * NBUF)  // larger than the buffer cache
+#define NPASSES 8
+
+char buf[4 * BSIZE];
+
+void fail(char *msg)
+{
+  printf(2, "readahead_test: %s\n", msg);
+  unlink(FILENAME);
+  exit();
+}
+
+// The byte at offset off of the file.  Every block differs from
+// its neighbours, so a block read ahead into the wrong place or
+// returned for the wrong offset shows up.
+int expect(int off)
+{
+  return (off / BSIZE * 31 + off % BSIZE) & 0xff;
+}
+
+void makefile(void)
+{
+  int fd, b, i;
+
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+    fail("cannot create file");
+  for (b = 0; b < NBLOCKS; b++)
+  {
+    for (i = 0; i < BSIZE; i++)
+      buf[i] = expect(b * BSIZE + i);
+    if (write(fd, buf, BSIZE) != BSIZE)
+      fail("write failed");
+  }
+  close(fd);
+}
+
+// Read the whole file front to back in chunk-byte reads and
+// compare every byte with what was written.
+void stream(int chunk)
+{
+  int fd, n, off, i;
+
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  off = 0;
+  while ((n = read(fd, buf, chunk)) > 0)
+  {
+    for (i = 0; i < n; i++)
+      if ((buf[i] & 0xff) != expect(off + i))
+        fail("streamed data is wrong");
+    off += n;
+  }
+  close(fd);
+  if (n < 0 || off != NBLOCKS * BSIZE)
+    fail("stream stopped early");
+}
+
+// Read every third block from the end backwards, which read-ahead
+// must not confuse with the sequential blocks it fetched.
+void stride(void)
+{
+  int fd, b, i;
+
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  for (b = NBLOCKS - 1; b >= 0; b -= 3)
+  {
+    if (pread(fd, buf, BSIZE, b * BSIZE) != BSIZE)
+      fail("pread failed");
+    for (i = 0; i < BSIZE; i++)
+      if ((buf[i] & 0xff) != expect(b * BSIZE + i))
+        fail("strided data is wrong");
+  }
+  close(fd);
+}
+
+void report(int window)
+{
+  int pass, start, ticks, kb;
+
+  set_readahead(window);
+  start = uptime();
+  for (pass = 0; pass < NPASSES; pass++)
+    stream(BSIZE);
+  ticks = uptime() - start;
+  kb = NBLOCKS * BSIZE / 1024 * NPASSES;
+  printf(1, "read-ahead %s: %d KB in %d ticks", window ? "on " : "off", kb, ticks);
+  if (ticks > 0)
+    printf(1, " (%d KB/s)", kb * 100 / ticks);
+  printf(1, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+  int old;
+
+  makefile();
+  old = set_readahead(0);
+  report(0);
+  report(8);
+
+  // Reads that straddle blocks, and reads that skip around,
+  // with the window open.
+  stream(300);
+  stream(BSIZE * 3);
+  stride();
+  stream(BSIZE);
+  set_readahead(old);
+  printf(1, "read-ahead data ok\n");
+
+  unlink(FILENAME);
+  exit();
+}
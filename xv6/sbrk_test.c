@@ -0,0 +1,92 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define CHUNK (1024 * 1024)
+#define ROUNDS 64
+#define PGSIZE 4096
+#define SPARSE (32 * 1024)     // what malloc's morecore() asks for
+#define NSPARSE 512            // 16 MB in all
+#define STRIDE (64 * 1024)     // touch one page in sixteen
+
+// Grow the heap the way malloc does and touch only a little of
+// it.  sbrk() should cost the same whatever the size, and only
+// the touched pages should take up memory.
+void sparse(void)
+{
+  int i, start, t, before, after;
+  char *p, *base;
+
+  before = memusage();
+  start = uptime();
+  base = sbrk(0);
+  for (i = 0; i < NSPARSE; i++)
+  {
+    if ((p = sbrk(SPARSE)) == (char *)-1)
+    {
+      printf(2, "sbrk_test: sparse sbrk failed\n");
+      exit();
+    }
+  }
+  t = uptime() - start;
+  printf(1, "sbrk: %d calls of %d KB in %d ticks\n", NSPARSE, SPARSE / 1024, t);
+
+  for (p = base; p < base + NSPARSE * SPARSE; p += STRIDE)
+  {
+    if (*p != 0)
+    {
+      printf(2, "sbrk_test: untouched memory is not zero\n");
+      exit();
+    }
+    *p = 1;
+  }
+  after = memusage();
+  printf(1, "sbrk: heap grew by %d KB, memory in use grew by %d KB\n",
+         NSPARSE * SPARSE / 1024, (after - before) / 1024);
+  if (after - before > NSPARSE * SPARSE / STRIDE * PGSIZE)
+  {
+    printf(2, "sbrk_test: untouched pages were allocated\n");
+    exit();
+  }
+  sbrk(-NSPARSE * SPARSE);
+  if (memusage() != before)
+  {
+    printf(2, "sbrk_test: shrinking did not free the heap\n");
+    exit();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int i, j, start, t;
+  char *p;
+
+  sparse();
+
+  start = uptime();
+  for (i = 0; i < ROUNDS; i++)
+  {
+    if ((p = sbrk(CHUNK)) == (char *)-1)
+    {
+      printf(2, "sbrk_test: sbrk failed\n");
+      exit();
+    }
+    for (j = 0; j < CHUNK; j += PGSIZE)
+    {
+      if (p[j] != 0)
+      {
+        printf(2, "sbrk_test: new memory is not zero\n");
+        exit();
+      }
+      p[j] = 1;
+    }
+    sbrk(-CHUNK);
+    // Give kzerod a chance to refill its pool, as a
+    // process that computes between allocations would.
+    sleep(1);
+  }
+  t = uptime() - start - ROUNDS;
+  printf(1, "sbrk: %d MB in %d ticks, %d MB/s\n",
+         ROUNDS, t, t > 0 ? ROUNDS * 100 / t : 0);
+  exit();
+}
@@ -0,0 +1,114 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define FILENAME "send.tmp"
+#define COPYNAME "send.copy"
+#define FILESIZE (1024 * 1024)
+
+char buf[512];
+
+void fail(char *msg)
+{
+  printf(2, "sendfile_test: %s\n", msg);
+  exit();
+}
+
+void makefile(void)
+{
+  int fd, i;
+
+  for (i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+    fail("cannot create file");
+  for (i = 0; i < FILESIZE / sizeof(buf); i++)
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write failed");
+  close(fd);
+}
+
+// Push the file down a pipe to a child that counts and checks
+// the bytes, as in "cat file | wc", either with read/write or
+// sendfile.
+void pipeline(int usesend)
+{
+  int fd, p[2], n, tot, start, i;
+
+  start = uptime();
+  if (pipe(p) < 0)
+    fail("pipe failed");
+  if (fork() == 0)
+  {
+    close(p[1]);
+    tot = 0;
+    while ((n = read(p[0], buf, sizeof(buf))) > 0)
+    {
+      for (i = 0; i < n; i++)
+        if (buf[i] != 'a' + (tot + i) % sizeof(buf) % 26)
+        {
+          printf(2, "sendfile_test: wrong byte at %d\n", tot + i);
+          exit();
+        }
+      tot += n;
+    }
+    if (tot != FILESIZE)
+      printf(2, "sendfile_test: reader got %d bytes\n", tot);
+    exit();
+  }
+  close(p[0]);
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  if (usesend)
+  {
+    while ((n = sendfile(p[1], fd, 0, 64 * 1024)) > 0)
+      ;
+  }
+  else
+  {
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+      if (write(p[1], buf, n) != n)
+        fail("pipe write failed");
+  }
+  if (n < 0)
+    fail("copy failed");
+  close(fd);
+  close(p[1]);
+  wait();
+  n = uptime() - start;
+  printf(1, "%s: 1 MB in %d ticks, %d KB/s\n",
+         usesend ? "sendfile" : "read/write", n, n ? 1024 * 100 / n : 0);
+}
+
+// sendfile with an explicit offset leaves the file offset alone.
+void checkoffset(void)
+{
+  int in, out, off;
+  char c;
+
+  if ((in = open(FILENAME, O_RDONLY)) < 0 ||
+      (out = open(COPYNAME, O_CREATE | O_RDWR)) < 0)
+    fail("cannot open files");
+  off = 3;
+  if (sendfile(out, in, &off, 1000) != 1000 || off != 1003)
+    fail("sendfile with offset failed");
+  if (read(in, &c, 1) != 1 || c != 'a')
+    fail("sendfile moved the file offset");
+  if (pread(out, &c, 1, 0) != 1 || c != 'd')
+    fail("sendfile copied the wrong bytes");
+  close(in);
+  close(out);
+  unlink(COPYNAME);
+  printf(1, "offset ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+  makefile();
+  pipeline(0);
+  pipeline(1);
+  checkoffset();
+  unlink(FILENAME);
+  exit();
+}
@@ -3,6 +3,7 @@
 #include "types.h"
 #include "user.h"
 #include "fcntl.h"
+#include "spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 void
@@ -130,6 +132,88 @@ runcmd(struct cmd *cmd)
   exit();
 }
 
+// Can cmd run through spawn() with at most NSPAWNACT - nact
+// more descriptor actions?  Simple commands, redirections and
+// pipelines can; lists, background jobs and empty commands
+// inside pipelines need runcmd() in a forked shell.
+int
+spawnable(struct cmd *cmd, int nact)
+{
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(nact > NSPAWNACT)
+    return 0;
+  switch(cmd->type){
+  case EXEC:
+    return ((struct execcmd*)cmd)->argv[0] != 0;
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    return spawnable(rcmd->cmd, nact + 2);
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    return spawnable(pcmd->left, nact + 3) && spawnable(pcmd->right, nact + 3);
+  }
+  return 0;
+}
+
+// Start the processes of a spawnable cmd, applying the nact
+// actions in act first.  Returns how many were started.
+int
+spawncmd(struct cmd *cmd, struct spawnact *act, int nact)
+{
+  int p[2], fd, n;
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(spawn(ecmd->argv[0], ecmd->argv, act, nact) < 0){
+      printf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      printf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    act[nact].op = SPAWN_DUP;
+    act[nact].fd = rcmd->fd;
+    act[nact].src = fd;
+    act[nact+1].op = SPAWN_CLOSE;
+    act[nact+1].fd = fd;
+    n = spawncmd(rcmd->cmd, act, nact + 2);
+    close(fd);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0)
+      panic("pipe");
+    act[nact].op = SPAWN_DUP;
+    act[nact].fd = 1;
+    act[nact].src = p[1];
+    act[nact+1].op = SPAWN_CLOSE;
+    act[nact+1].fd = p[0];
+    act[nact+2].op = SPAWN_CLOSE;
+    act[nact+2].fd = p[1];
+    n = spawncmd(pcmd->left, act, nact + 3);
+    act[nact].fd = 0;
+    act[nact].src = p[0];
+    n += spawncmd(pcmd->right, act, nact + 3);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  panic("spawncmd");
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +229,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  struct spawnact act[NSPAWNACT];
+  struct cmd *cmd;
+  int fd, n;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +250,19 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    // Commands that spawn() can start directly skip copying
+    // the shell's address space.
+    if(spawnable(cmd, 0)){
+      for(n = spawncmd(cmd, act, 0); n > 0; n--)
+        wait();
+    } else {
+      if(fork1() == 0)
+        runcmd(cmd);
+      wait();
+    }
+    freecmd(cmd);
   }
   exit();
 }
@@ -319,6 +415,19 @@ peek(char **ps, char *es, char *toks)
   return *s && strchr(toks, *s);
 }
 
+// The shell parses commands itself rather than in a child, so
+// a syntax error must not exit: it is reported and recorded
+// here, and parsecmd() then returns 0.
+int parseerr;
+
+void
+syntax(char *msg)
+{
+  if(!parseerr)
+    printf(2, "%s\n", msg);
+  parseerr = 1;
+}
+
 struct cmd *parseline(char**, char*);
 struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
@@ -330,12 +439,17 @@ parsecmd(char *s)
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +493,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +521,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +549,18 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
+    if(argc >= MAXARGS){
+      syntax("too many args");
+      argc--;
+      break;
+    }
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +614,41 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free a command tree built by parsecmd().
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
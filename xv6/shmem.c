@@ -0,0 +1,230 @@
+//
+// Named shared memory.
+//
+// openshmem(id) attaches the segment named id, creating it if no
+// process has it attached, and closeshmem(id) detaches it.  The
+// segments live in the shpage table; each process records the
+// ones it has attached in its shmemtable, and slot k of that
+// table is mapped at SHMBASE + k*SHMSIZE.  A segment's pages are
+// reference counted like any other page, so freevm() drops the
+// references of a page table that still maps them, and the
+// segment itself goes away when its last process detaches.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "shmem.h"
+
+struct shpage {
+  int id;                      // Name given to openshmem()
+  int refs;                    // Attached processes; 0 if unused
+  char *pages[SHMPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shpage seg[NSHMEM];
+} shm;
+
+void
+shmeminit(void)
+{
+  initlock(&shm.lock, "shmem");
+}
+
+static uint
+slotaddr(int k)
+{
+  return SHMBASE + k*SHMSIZE;
+}
+
+// Map the pages of s at slot k of pgdir.
+static int
+shmemmap(pde_t *pgdir, int k, struct shpage *s)
+{
+  int i;
+
+  for(i = 0; i < SHMPAGES; i++){
+    if(mappages(pgdir, (char*)slotaddr(k) + i*PGSIZE, PGSIZE,
+                V2P(s->pages[i]), PTE_W|PTE_U) < 0)
+      return -1;
+    kdup(s->pages[i]);
+  }
+  return 0;
+}
+
+// Remove whatever is mapped at slot k of pgdir.
+static void
+shmemunmap(pde_t *pgdir, int k)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = slotaddr(k); a < slotaddr(k) + SHMSIZE; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    kfree(P2V(PTE_ADDR(*pte)));
+    *pte = 0;
+  }
+}
+
+// Drop a process's reference to s.  Caller holds shm.lock.
+static void
+shmemput(struct shpage *s)
+{
+  int i;
+
+  if(--s->refs > 0)
+    return;
+  for(i = 0; i < SHMPAGES; i++){
+    if(s->pages[i])
+      kfree(s->pages[i]);
+    s->pages[i] = 0;
+  }
+}
+
+// Attach the segment id to the current process, creating it
+// zero-filled if need be.  Returns its address, or 0.
+char*
+openshmem(int id)
+{
+  struct proc *p = myproc();
+  struct shpage *s, *fs;
+  int i, k;
+
+  acquire(&shm.lock);
+  fs = 0;
+  for(s = shm.seg; s < &shm.seg[NSHMEM]; s++){
+    if(s->refs > 0 && s->id == id)
+      break;
+    if(s->refs == 0 && fs == 0)
+      fs = s;
+  }
+  if(s == &shm.seg[NSHMEM])
+    s = 0;
+
+  // Already attached?
+  for(k = 0; s && k < NSHMEM; k++){
+    if(p->shmemtable[k] == s){
+      release(&shm.lock);
+      return (char*)slotaddr(k);
+    }
+  }
+  for(k = 0; k < NSHMEM && p->shmemtable[k]; k++)
+    ;
+  if(k == NSHMEM || (s == 0 && fs == 0))
+    goto bad;
+
+  if(s == 0){
+    s = fs;
+    s->id = id;
+    s->refs = 1;
+    for(i = 0; i < SHMPAGES; i++){
+      if((s->pages[i] = kzalloc()) == 0){
+        shmemput(s);
+        goto bad;
+      }
+    }
+  } else
+    s->refs++;
+
+  if(shmemmap(p->pgdir, k, s) < 0){
+    shmemunmap(p->pgdir, k);
+    shmemput(s);
+    goto bad;
+  }
+  p->shmemtable[k] = s;
+  release(&shm.lock);
+  return (char*)slotaddr(k);
+
+bad:
+  release(&shm.lock);
+  return 0;
+}
+
+// Detach the segment id from the current process.
+int
+closeshmem(int id)
+{
+  struct proc *p = myproc();
+  int k;
+
+  acquire(&shm.lock);
+  for(k = 0; k < NSHMEM; k++)
+    if(p->shmemtable[k] && p->shmemtable[k]->id == id)
+      break;
+  if(k == NSHMEM){
+    release(&shm.lock);
+    return -1;
+  }
+  shmemunmap(p->pgdir, k);
+  lcr3(V2P(p->pgdir));
+  shmemput(p->shmemtable[k]);
+  p->shmemtable[k] = 0;
+  release(&shm.lock);
+  return 0;
+}
+
+// Detach every segment of p.  Called by exec() and exit(),
+// and by fork() for a child it could not finish.
+void
+shmemrelease(struct proc *p)
+{
+  int k;
+
+  acquire(&shm.lock);
+  for(k = 0; k < NSHMEM; k++){
+    if(p->shmemtable[k] == 0)
+      continue;
+    shmemunmap(p->pgdir, k);
+    shmemput(p->shmemtable[k]);
+    p->shmemtable[k] = 0;
+  }
+  if(p == myproc())
+    lcr3(V2P(p->pgdir));
+  release(&shm.lock);
+}
+
+// Attach the child np to every segment of p, at the same
+// addresses.  On failure the caller must shmemrelease(np).
+int
+shmemfork(struct proc *p, struct proc *np)
+{
+  int k;
+
+  acquire(&shm.lock);
+  for(k = 0; k < NSHMEM; k++){
+    if(p->shmemtable[k] == 0)
+      continue;
+    p->shmemtable[k]->refs++;
+    np->shmemtable[k] = p->shmemtable[k];
+    if(shmemmap(np->pgdir, k, np->shmemtable[k]) < 0){
+      release(&shm.lock);
+      return -1;
+    }
+  }
+  release(&shm.lock);
+  return 0;
+}
+
+// Check that a system call buffer [va, va+n) lies in one
+// segment attached to the current process.
+int
+shmemuser(uint va, uint n)
+{
+  struct proc *p = myproc();
+  int k;
+
+  if(va < SHMBASE || va - SHMBASE >= NSHMEM*SHMSIZE)
+    return -1;
+  k = (va - SHMBASE) / SHMSIZE;
+  if(p->shmemtable[k] == 0 || n > slotaddr(k) + SHMSIZE - va)
+    return -1;
+  return 0;
+}
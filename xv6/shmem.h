@@ -0,0 +1,3 @@
+// Shared memory segments, attached with openshmem().
+#define SHMPAGES     16  // pages in each segment
+#define SHMSIZE      (SHMPAGES*4096)  // bytes in each segment
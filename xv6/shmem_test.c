@@ -0,0 +1,160 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "shmem.h"
+
+#define ID 42
+#define HALF (SHMSIZE / 2)
+#define TOTAL (8 * 1024 * 1024)
+
+void fail(char *msg)
+{
+  printf(2, "shmem_test: %s\n", msg);
+  exit();
+}
+
+// Segments must be shared with processes that open them and
+// with children, and vanish once the last process closes them.
+void checkshmem(void)
+{
+  char *a, *b;
+  int p[2];
+  char c;
+
+  if ((a = openshmem(ID)) == 0)
+    fail("openshmem failed");
+  if (openshmem(ID) != a)
+    fail("second open moved the segment");
+  a[0] = 'p';
+  a[SHMSIZE - 1] = 'p';
+  if (pipe(p) < 0)
+    fail("pipe failed");
+  if (fork() == 0)
+  {
+    // Inherited from the parent.
+    if (a[0] != 'p' || a[SHMSIZE - 1] != 'p')
+      fail("child does not see the parent's segment");
+    a[1] = 'c';
+    closeshmem(ID);
+    // Opened afresh, while the parent still has it.
+    if ((b = openshmem(ID)) == 0 || b[1] != 'c')
+      fail("child reopen lost the data");
+    write(p[1], "x", 1);
+    exit();
+  }
+  read(p[0], &c, 1);
+  wait();
+  if (a[1] != 'c')
+    fail("parent does not see the child's write");
+  if (closeshmem(ID) < 0 || closeshmem(ID) == 0)
+    fail("closeshmem");
+  if ((a = openshmem(ID)) == 0 || a[0] != 0 || a[1] != 0)
+    fail("segment outlived its last close");
+  closeshmem(ID);
+  close(p[0]);
+  close(p[1]);
+  printf(1, "shmem ok\n");
+}
+
+void fill(char *buf, int n, int seq)
+{
+  memset(buf, seq, n);
+}
+
+void check(char *buf, int n, int seq)
+{
+  int i;
+
+  for (i = 0; i < n; i += 512)
+    if (buf[i] != (char)seq)
+      fail("consumer got the wrong data");
+}
+
+// Move TOTAL bytes from a producer to a consumer in HALF-byte
+// chunks written straight into the two halves of a segment.
+// One-byte tokens on two pipes say which halves are full and
+// which are free again, so only they go through the kernel.
+int viashmem(void)
+{
+  int full[2], empty[2], i, start;
+  char *buf, tok;
+
+  if ((buf = openshmem(ID)) == 0)
+    fail("openshmem failed");
+  if (pipe(full) < 0 || pipe(empty) < 0)
+    fail("pipe failed");
+  write(empty[1], "ee", 2);
+  start = uptime();
+  if (fork() == 0)
+  {
+    for (i = 0; i < TOTAL / HALF; i++)
+    {
+      read(empty[0], &tok, 1);
+      fill(buf + (i % 2) * HALF, HALF, i);
+      write(full[1], "f", 1);
+    }
+    exit();
+  }
+  for (i = 0; i < TOTAL / HALF; i++)
+  {
+    read(full[0], &tok, 1);
+    check(buf + (i % 2) * HALF, HALF, i);
+    write(empty[1], "e", 1);
+  }
+  wait();
+  closeshmem(ID);
+  close(full[0]);
+  close(full[1]);
+  close(empty[0]);
+  close(empty[1]);
+  return uptime() - start;
+}
+
+// The same transfer with the data itself going through a pipe.
+int viapipe(void)
+{
+  static char buf[HALF];
+  int p[2], i, n, m, start;
+
+  if (pipe(p) < 0)
+    fail("pipe failed");
+  start = uptime();
+  if (fork() == 0)
+  {
+    close(p[0]);
+    for (i = 0; i < TOTAL / HALF; i++)
+    {
+      fill(buf, HALF, i);
+      if (write(p[1], buf, HALF) != HALF)
+        fail("pipe write failed");
+    }
+    exit();
+  }
+  close(p[1]);
+  for (i = 0; i < TOTAL / HALF; i++)
+  {
+    for (n = 0; n < HALF; n += m)
+      if ((m = read(p[0], buf + n, HALF - n)) <= 0)
+        fail("pipe read failed");
+    check(buf, HALF, i);
+  }
+  wait();
+  close(p[0]);
+  return uptime() - start;
+}
+
+void report(char *what, int t)
+{
+  if (t == 0)
+    t = 1;
+  printf(1, "%s: %d KB in %d ticks, %d KB/s\n",
+         what, TOTAL / 1024, t, TOTAL / 1024 * 100 / t);
+}
+
+int main(void)
+{
+  checkshmem();
+  report("shared memory", viashmem());
+  report("pipe", viapipe());
+  exit();
+}
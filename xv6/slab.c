@@ -0,0 +1,219 @@
+//
+// Object caches for small kernel structures, so that they do not
+// each take a whole page from kalloc().
+//
+// A cache hands out objects of one size, carved from slabs: pages
+// that start with a struct slab and hold as many objects as fit
+// after it.  Free objects in a slab are linked through their first
+// word.  Each CPU keeps a magazine of up to MAGSIZE free objects,
+// so most kmem_cache_alloc() and kmem_cache_free() calls touch only
+// that CPU's magazine with interrupts off; an empty magazine is
+// refilled, and a full one half drained, under the cache's lock.
+// A slab whose objects are all free goes back to kalloc().
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NCACHE  8   // caches in the system
+#define MAGSIZE 16  // free objects each CPU keeps per cache
+
+struct slab {
+  struct slab *next;   // on the cache's partial list
+  struct slab *prev;
+  void *free;          // free objects; 0 if the slab is full
+  int inuse;           // objects not on free
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;           // object size, a multiple of 4
+  uint perslab;        // objects in a slab
+  struct spinlock lock;
+  struct slab *partial; // slabs with free objects
+  uint nslab;          // pages held
+  uint nobj;           // objects out of the slabs, magazines included
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct kmem_cache cache[NCACHE];
+} slabs;
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Create a cache of objects of size bytes.  Panics if there
+// is no room, since caches are only made at boot.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 3) & ~3;
+  if(size < sizeof(void*))
+    size = sizeof(void*);
+  if(size > PGSIZE - SLABHDR)
+    panic("kmem_cache_create: too big");
+  acquire(&slabs.lock);
+  if(slabs.n == NCACHE)
+    panic("kmem_cache_create: too many");
+  c = &slabs.cache[slabs.n++];
+  release(&slabs.lock);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  initlock(&c->lock, name);
+  return c;
+}
+
+static void
+slabunlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+slablink(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Add a new slab to c.  Caller holds c->lock.
+static int
+grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return -1;
+  s->free = 0;
+  s->inuse = 0;
+  for(i = c->perslab - 1; i >= 0; i--){
+    obj = (char*)s + SLABHDR + i*c->size;
+    *(void**)obj = s->free;
+    s->free = obj;
+  }
+  slablink(c, s);
+  c->nslab++;
+  return 0;
+}
+
+// Fill the empty magazine m half way from the slabs of c.
+static void
+refill(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *obj;
+
+  acquire(&c->lock);
+  while(m->n < MAGSIZE/2){
+    if(c->partial == 0 && grow(c) < 0)
+      break;
+    s = c->partial;
+    obj = s->free;
+    s->free = *(void**)obj;
+    s->inuse++;
+    if(s->free == 0)
+      slabunlink(c, s);
+    m->obj[m->n++] = obj;
+    c->nobj++;
+  }
+  release(&c->lock);
+}
+
+// Return half of the full magazine m to the slabs of c.
+static void
+drain(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *obj;
+
+  acquire(&c->lock);
+  while(m->n > MAGSIZE/2){
+    obj = m->obj[--m->n];
+    s = (struct slab*)PGROUNDDOWN((uint)obj);
+    if(s->free == 0)
+      slablink(c, s);
+    *(void**)obj = s->free;
+    s->free = obj;
+    c->nobj--;
+    if(--s->inuse == 0){
+      slabunlink(c, s);
+      kfree((char*)s);
+      c->nslab--;
+    }
+  }
+  release(&c->lock);
+}
+
+// Allocate an object from c.  Its contents are undefined.
+// Returns 0 if memory is exhausted.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0)
+    refill(c, m);
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  popcli();
+  return obj;
+}
+
+// Give obj, which came from c, back to it.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE)
+    drain(c, m);
+  m->obj[m->n++] = obj;
+  popcli();
+}
+
+// Print each cache's usage to the console.
+void
+slabdump(void)
+{
+  struct kmem_cache *c;
+
+  for(c = slabs.cache; c < &slabs.cache[slabs.n]; c++)
+    cprintf("%s: %d-byte objects, %d in use or cached, %d pages\n",
+            c->name, c->size, c->nobj, c->nslab);
+}
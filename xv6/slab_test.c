@@ -0,0 +1,59 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NPIPE 16
+#define NLOOP 2000
+
+void fail(char *msg)
+{
+  printf(2, "slab_test: %s\n", msg);
+  exit();
+}
+
+// Keep NPIPE pipes open and see what each one costs.  The pipe
+// structures and their files share slab pages, so each pipe
+// should take little more than its one-page buffer.
+void footprint(void)
+{
+  int fds[NPIPE][2], i, before, after;
+
+  before = freemem();
+  for (i = 0; i < NPIPE; i++)
+    if (pipe(fds[i]) < 0)
+      fail("pipe failed");
+  after = freemem();
+  printf(1, "%d pipes: %d bytes each\n", NPIPE, (before - after) / NPIPE);
+  slabinfo();
+  for (i = 0; i < NPIPE; i++)
+  {
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+}
+
+// Creating and closing a pipe allocates and frees a pipe and
+// two files.
+void latency(void)
+{
+  int fds[2], i, start, t;
+
+  start = uptime();
+  for (i = 0; i < NLOOP; i++)
+  {
+    if (pipe(fds) < 0)
+      fail("pipe failed");
+    close(fds[0]);
+    close(fds[1]);
+  }
+  t = uptime() - start;
+  printf(1, "pipe+close: %d in %d ticks, %d us each\n",
+         NLOOP, t, t * 10000 / NLOOP);
+}
+
+int main(void)
+{
+  footprint();
+  latency();
+  exit();
+}
@@ -0,0 +1,13 @@
+// File descriptor actions for spawn().  The child starts with
+// copies of the caller's open files and applies the actions in
+// order before it runs.
+struct spawnact {
+  int op;   // SPAWN_DUP or SPAWN_CLOSE
+  int fd;   // child descriptor to set or close
+  int src;  // for SPAWN_DUP, child descriptor to copy into fd
+};
+
+#define SPAWN_DUP    1  // make fd refer to the same file as src
+#define SPAWN_CLOSE  2  // close fd
+
+#define NSPAWNACT   16  // most actions in one spawn()
@@ -0,0 +1,96 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "spawn.h"
+
+#define NCMD 200
+
+void fail(char *msg)
+{
+  printf(2, "spawn_test: %s\n", msg);
+  exit();
+}
+
+// spawn() must apply the descriptor actions in order
+// and leave the parent's descriptors alone.
+void checkspawn(void)
+{
+  struct spawnact act[2];
+  char *args[] = {"echo", "hello", 0};
+  char buf[16];
+  int fd, n;
+
+  if ((fd = open("spawn_out", O_CREATE | O_RDWR)) < 0)
+    fail("open failed");
+  act[0].op = SPAWN_DUP;
+  act[0].fd = 1;
+  act[0].src = fd;
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = fd;
+  if (spawn("echo", args, act, 2) < 0)
+    fail("spawn failed");
+  wait();
+  if (spawn("no_such_program", args, act, 2) >= 0)
+    fail("spawn of a missing program succeeded");
+  close(fd);
+
+  if ((fd = open("spawn_out", O_RDONLY)) < 0)
+    fail("reopen failed");
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  unlink("spawn_out");
+  if (n != 6 || buf[0] != 'h' || buf[4] != 'o' || buf[5] != '\n')
+    fail("child output went to the wrong place");
+  printf(1, "spawn ok\n");
+}
+
+// Run a script of NCMD copies of line through sh and
+// report how many commands it got through per second.
+void script(char *what, char *line)
+{
+  char *args[] = {"sh", 0};
+  int fd, i, start, t;
+
+  if ((fd = open("spawn_sh", O_CREATE | O_WRONLY)) < 0)
+    fail("create script failed");
+  for (i = 0; i < NCMD; i++)
+    if (write(fd, line, strlen(line)) != strlen(line))
+      fail("write script failed");
+  close(fd);
+
+  start = uptime();
+  if (fork() == 0)
+  {
+    close(0);
+    if (open("spawn_sh", O_RDONLY) != 0)
+      fail("open script failed");
+    close(1);
+    close(2);
+    if (open("spawn_out", O_CREATE | O_WRONLY) != 1)
+      fail("open output failed");
+    dup(1);
+    exec("sh", args);
+    fail("exec sh failed");
+  }
+  wait();
+  t = uptime() - start;
+  if (t == 0)
+    t = 1;
+  printf(1, "%s: %d commands in %d ticks, %d commands/sec\n",
+         what, NCMD, t, NCMD * 100 / t);
+  unlink("spawn_sh");
+  unlink("spawn_out");
+}
+
+int main(void)
+{
+  checkspawn();
+  // sh runs a list in a forked copy of itself, so the
+  // trailing ";" measures the old fork+exec path.
+  script("simple, spawn", "echo x\n");
+  script("simple, fork", "echo x ;\n");
+  script("pipeline, spawn", "echo x | wc\n");
+  script("pipeline, fork", "echo x | wc ;\n");
+  exit();
+}
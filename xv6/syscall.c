@@ -22,6 +22,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(uvmpagein(addr, 4, 0) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -34,6 +36,8 @@ fetchfloat(uint addr, float *fp)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(uvmpagein(addr, 4, 0) < 0)
+    return -1;
   *fp = *(float*)(addr);
   return 0;
 }
@@ -52,6 +56,8 @@ fetchstr(uint addr, char **pp)
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && uvmpagein((uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -79,20 +85,35 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || checkuser((uint)i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Check that [va, va+n) is memory of the current process that
+// a system call may use, page all of it in and break any
+// copy-on-write sharing, since the kernel may write to it.
+int
+checkuser(uint va, uint n)
+{
+  struct proc *curproc = myproc();
+
+  if(va < curproc->sz && n <= curproc->sz - va)
+    return uvmpagein(va, n, 1);
+  if(shmemuser(va, n) == 0)
+    return 0;
+  return mmapuser(va, n);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (The string must lie below sz, and shared memory segments and
+// mappings all lie above it, so no other process can change the
+// string between this check and its use by the kernel.)
 int
 argstr(int n, char **pp)
 {
@@ -135,6 +156,26 @@ extern int sys_init_prioritylock(void);
 extern int sys_acquire_prioritylock(void);
 extern int sys_release_prioritylock(void);
 extern int sys_print_cpu_syscalls_count(void);
+extern int sys_set_io_queue_depth(void);
+extern int sys_set_readahead(void);
+extern int sys_lseek(void);
+extern int sys_reflink_file(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_msync(void);
+extern int sys_sendfile(void);
+extern int sys_fcntl(void);
+extern int sys_context_switches(void);
+extern int sys_spawn(void);
+extern int sys_memusage(void);
+extern int sys_freemem(void);
+extern int sys_openshmem(void);
+extern int sys_closeshmem(void);
+extern int sys_slabinfo(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -170,6 +211,26 @@ static int (*syscalls[])(void) = {
 [SYS_acquire_prioritylock] sys_acquire_prioritylock,
 [SYS_release_prioritylock] sys_release_prioritylock,
 [SYS_print_cpu_syscalls_count] sys_print_cpu_syscalls_count,
+[SYS_set_io_queue_depth] sys_set_io_queue_depth,
+[SYS_set_readahead] sys_set_readahead,
+[SYS_lseek]   sys_lseek,
+[SYS_reflink_file] sys_reflink_file,
+[SYS_readv]  sys_readv,
+[SYS_writev] sys_writev,
+[SYS_pread]  sys_pread,
+[SYS_pwrite] sys_pwrite,
+[SYS_mmap]   sys_mmap,
+[SYS_munmap] sys_munmap,
+[SYS_msync]  sys_msync,
+[SYS_sendfile] sys_sendfile,
+[SYS_fcntl]  sys_fcntl,
+[SYS_context_switches] sys_context_switches,
+[SYS_spawn]  sys_spawn,
+[SYS_memusage] sys_memusage,
+[SYS_freemem] sys_freemem,
+[SYS_openshmem] sys_openshmem,
+[SYS_closeshmem] sys_closeshmem,
+[SYS_slabinfo] sys_slabinfo,
 };
 
 void
@@ -33,6 +33,26 @@
 #define SYS_acquire_prioritylock 31
 #define SYS_release_prioritylock 32
 #define SYS_print_cpu_syscalls_count 33
+#define SYS_set_io_queue_depth 34
+#define SYS_set_readahead 35
+#define SYS_lseek 36
+#define SYS_reflink_file 37
+#define SYS_readv  38
+#define SYS_writev 39
+#define SYS_pread  40
+#define SYS_pwrite 41
+#define SYS_mmap   42
+#define SYS_munmap 43
+#define SYS_msync  44
+#define SYS_sendfile 45
+#define SYS_fcntl  46
+#define SYS_context_switches 47
+#define SYS_spawn  48
+#define SYS_memusage 49
+#define SYS_freemem 50
+#define SYS_openshmem 51
+#define SYS_closeshmem 52
+#define SYS_slabinfo 53
 
 
 
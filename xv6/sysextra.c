@@ -63,3 +63,54 @@ int sys_print_cpu_syscalls_count(void)
     total_syscall_counter = 0;
     return 0;
 }
+
+int sys_set_io_queue_depth(void)
+{
+    int depth;
+
+    if (argint(0, &depth) < 0)
+        return -1;
+    return setiodepth(depth);
+}
+
+int sys_set_readahead(void)
+{
+    int nblocks;
+
+    if (argint(0, &nblocks) < 0)
+        return -1;
+    return setreadahead(nblocks);
+}
+
+// Total number of context switches into a process on all CPUs.
+int sys_context_switches(void)
+{
+    uint n = 0;
+
+    for (int i = 0; i < ncpu; i++)
+        n += cpus[i].nswitch;
+    return n;
+}
+
+// Bytes of physical memory behind the current process's
+// heap, stack and program, which are only allocated when
+// first touched.
+int sys_memusage(void)
+{
+    struct proc *p = myproc();
+
+    return residentuvm(p->pgdir, p->sz) * PGSIZE;
+}
+
+// Bytes of free physical memory in the whole system.
+int sys_freemem(void)
+{
+    return kfreepages() * PGSIZE;
+}
+
+// Print the usage of the kernel's object caches.
+int sys_slabinfo(void)
+{
+    slabdump();
+    return 0;
+}
@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "mman.h"
+#include "spawn.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -90,6 +93,164 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Move the offset of an inode file.  The new offset must lie
+// within the file, since writei() cannot leave holes.
+int
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+  uint base;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+
+  ilock(f->ip);
+  if(whence == SEEK_SET)
+    base = 0;
+  else if(whence == SEEK_CUR)
+    base = f->off;
+  else if(whence == SEEK_END)
+    base = f->ip->size;
+  else {
+    iunlock(f->ip);
+    return -1;
+  }
+  if((int)base + off < 0 || base + off > f->ip->size){
+    iunlock(f->ip);
+    return -1;
+  }
+  f->off = base + off;
+  iunlock(f->ip);
+  return f->off;
+}
+
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Copy n bytes from in_fd to out_fd inside the kernel.  If the
+// offset pointer is not null, read in_fd from *off and update
+// *off instead of the file offset.
+int
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n, uoff;
+  int *off;
+  uint o;
+  int r;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argint(2, &uoff) < 0 || argint(3, &n) < 0 || n < 0)
+    return -1;
+  if(uoff == 0)
+    return filesend(out, in, 0, n);
+  // Read *off once: it may be in memory another process can change.
+  if(argptr(2, (char**)&off, sizeof(*off)) < 0)
+    return -1;
+  if((int)(o = *off) < 0)
+    return -1;
+  r = filesend(out, in, &o, n);
+  *off = o;
+  return r;
+}
+
+#define IOV_TOTMAX 0x7fffffff  // most bytes one readv() or writev() moves
+
+// Copy the iovec array in argument n, with *cnt entries given
+// by argument n+1, into iov, which has room for IOV_MAX, and
+// check that every buffer lies in the process's memory.  The
+// checks are made on the copy, since the user's array may be in
+// memory that another process can change.
+static int
+argiov(int n, struct iovec *iov, int *cnt)
+{
+  struct iovec *uiov;
+  uint tot;
+  int i;
+
+  if(argint(n+1, cnt) < 0 || *cnt < 0 || *cnt > IOV_MAX)
+    return -1;
+  if(argptr(n, (char**)&uiov, *cnt*sizeof(struct iovec)) < 0)
+    return -1;
+  memmove(iov, uiov, *cnt*sizeof(struct iovec));
+  tot = 0;
+  for(i = 0; i < *cnt; i++){
+    // Clamp the lengths so the total fits the int return value.
+    if(iov[i].iov_len > IOV_TOTMAX - tot)
+      iov[i].iov_len = IOV_TOTMAX - tot;
+    tot += iov[i].iov_len;
+    if(checkuser((uint)iov[i].iov_base, iov[i].iov_len) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Read into each buffer in turn, stopping early on a short
+// read, so that one call does the work of up to IOV_MAX reads.
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, i, r, tot;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = fileread(f, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, i, r, tot;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = filewrite(f, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+  }
+  return tot;
+}
+
 int
 sys_close(void)
 {
@@ -218,6 +379,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcput(dp, name, 0, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -257,7 +419,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
@@ -274,8 +436,18 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // dp is full: undo the new inode.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
@@ -327,6 +499,7 @@ sys_open(void)
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  f->ranext = f->rawin = f->raend = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
   return fd;
@@ -393,19 +566,17 @@ sys_chdir(void)
   return 0;
 }
 
-int
-sys_exec(void)
+// Fetch the null-terminated array of argument strings at user
+// address uargv into argv, which holds MAXARG entries.
+static int
+fetchargv(uint uargv, char **argv)
 {
-  char *path, *argv[MAXARG];
   int i;
-  uint uargv, uarg;
+  uint uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv))
+    if(i >= MAXARG)
       return -1;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
       return -1;
@@ -416,9 +587,51 @@ sys_exec(void)
     if(fetchstr(uarg, &argv[i]) < 0)
       return -1;
   }
+  return 0;
+}
+
+int
+sys_exec(void)
+{
+  char *path, *argv[MAXARG];
+  uint uargv;
+
+  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
   return exec(path, argv);
 }
 
+int
+sys_spawn(void)
+{
+  char *path, *argv[MAXARG];
+  uint uargv;
+  struct spawnact *uact, act[NSPAWNACT];
+  int i, nact;
+
+  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0 ||
+     argint(3, &nact) < 0 || nact < 0 || nact > NSPAWNACT ||
+     argptr(2, (char**)&uact, nact*sizeof(*uact)) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+  // Check a copy: shared memory could change the user's array
+  // between the check and spawn() using it to index ofile[].
+  memmove(act, uact, nact*sizeof(*uact));
+  for(i = 0; i < nact; i++){
+    if(act[i].fd < 0 || act[i].fd >= NOFILE)
+      return -1;
+    if(act[i].op == SPAWN_DUP && (act[i].src < 0 || act[i].src >= NOFILE))
+      return -1;
+    if(act[i].op != SPAWN_DUP && act[i].op != SPAWN_CLOSE)
+      return -1;
+  }
+  return spawn(path, argv, act, nact);
+}
+
 int
 sys_pipe(void)
 {
@@ -443,12 +656,25 @@ sys_pipe(void)
   return 0;
 }
 
-int sys_copy_file(void)
+// Blocks per copy_file transaction: each copied block logs
+// itself and maybe a bitmap block, on top of the inode and up
+// to three indirect blocks (the single indirect block and both
+// levels of the double-indirect one), as in inodewrite().
+#define COPYBATCH ((MAXOPBLOCKS-4) / 2)
+// Blocks per reflink_file transaction, which logs only share
+// map, bitmap and indirect blocks and the inode; iclone()
+// keeps it within the log's budget.
+#define SHAREBATCH 64
+
+// Copy file src to new file dst a block at a time, or share
+// its blocks copy-on-write if share is set, in transactions
+// sized to fit the log.
+static int copyfile(char *who, int share)
 {
   char *src, *dst;
   if (argstr(0, &src) < 0 || argstr(1, &dst) < 0)
   {
-    cprintf("copy_file: couldn't get file names.\n");
+    cprintf("%s: couldn't get file names.\n", who);
     return -1;
   }
 
@@ -458,76 +684,130 @@ int sys_copy_file(void)
 
   if (srcIp == 0)
   {
+    if (dstIp != 0)
+      iput(dstIp);
     end_op();
-    cprintf("copy_file: src file doesn't exist.\n");
+    cprintf("%s: src file doesn't exist.\n", who);
     return -1;
   }
   if (srcIp == dstIp)
   {
-    cprintf("copy_file: src and dst file are same and a file cannot be copied in itself.\n");
+    cprintf("%s: src and dst file are same and a file cannot be copied in itself.\n", who);
+    iput(srcIp);
+    iput(dstIp);
     end_op();
     return -1;
   }
   if (dstIp != 0)
   {
-    cprintf("copy_file: dst file already exists.\n");
+    cprintf("%s: dst file already exists.\n", who);
+    iput(srcIp);
+    iput(dstIp);
     end_op();
     return -1;
   }
 
-  dstIp = create(dst, T_FILE, 0, 0);
-  if (dstIp == 0)
+  ilock(srcIp);
+  if (srcIp->type != T_FILE)
   {
+    cprintf("%s: src is not a file.\n", who);
+    iunlockput(srcIp);
     end_op();
     return -1;
   }
+  iunlock(srcIp);
 
-  struct file *dstFd;
-  if ((dstFd = filealloc()) == 0)
+  dstIp = create(dst, T_FILE, 0, 0);
+  if (dstIp == 0)
   {
-    iunlockput(dstIp);
+    iput(srcIp);
     end_op();
     return -1;
   }
-
   iunlock(dstIp);
+  end_op();
 
-  struct file *srcFd;
-  if ((srcFd = filealloc()) == 0)
+  uint bn = 0;
+  int n;
+  do
   {
+    begin_op();
+    ilock(dstIp);
+    ilock(srcIp);
+    n = iclone(dstIp, srcIp, bn, share ? SHAREBATCH : COPYBATCH, share);
+    iunlock(srcIp);
+    iunlock(dstIp);
     end_op();
-    return -1;
-  }
+    bn += n;
+  } while (n > 0);
 
-  srcFd->type = FD_INODE;
-  srcFd->ip = srcIp;
-  srcFd->off = 0;
-  srcFd->readable = 1;
-  srcFd->writable = 0;
+  begin_op();
+  iput(srcIp);
+  iput(dstIp);
+  end_op();
 
-  dstFd->type = FD_INODE;
-  dstFd->ip = dstIp;
-  dstFd->off = 0;
-  dstFd->readable = 0;
-  dstFd->writable = 1;
+  return (n == 0) ? 0 : -1;
+}
 
-  char buffer[512] = {'\0'};
-  int read_bit_count;
+int sys_copy_file(void)
+{
+  return copyfile("copy_file", 0);
+}
 
-  while ((read_bit_count = fileread(srcFd, buffer, 512)) > 0)
-  {
-    if (filewrite(dstFd, buffer, read_bit_count) != read_bit_count)
-    {
-      break; // this means there was error in writing in dst file
-    }
-  }
+int sys_reflink_file(void)
+{
+  return copyfile("reflink_file", 1);
+}
 
-  fileclose(srcFd);
-  fileclose(dstFd);
+// Map a file into memory.  The address argument is only a
+// hint and is ignored; mappings are placed above MMAPBASE.
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int len, prot, flags, off;
 
-  end_op();
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 ||
+     argint(5, &off) < 0 || len <= 0 || off < 0)
+    return -1;
+  return mmapfile(f, len, prot, flags, off);
+}
 
-  int return_condition;
-  return_condition = (read_bit_count == 0) ? 0 : -1;
-  return return_condition;
-}
\ No newline at end of file
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+int
+sys_msync(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return msync(addr, len);
+}
+
+// Only the pipe buffer size commands are supported.
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  if(f->type != FD_PIPE)
+    return -1;
+  if(cmd == F_GETPIPE_SZ)
+    return pipesize(f->pipe, 0);
+  if(cmd == F_SETPIPE_SZ && arg > 0)
+    return pipesize(f->pipe, arg);
+  return -1;
+}
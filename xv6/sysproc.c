@@ -55,6 +55,26 @@ sys_sbrk(void)
   return addr;
 }
 
+int
+sys_openshmem(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return (int)openshmem(id);
+}
+
+int
+sys_closeshmem(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return closeshmem(id);
+}
+
 int
 sys_sleep(void)
 {
@@ -36,6 +36,8 @@ idtinit(void)
 void
 trap(struct trapframe *tf)
 {
+  int r;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -81,6 +83,26 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // A user write to a copy-on-write page, the first touch of a
+    // program or heap page, or a touch of a memory-mapped file that
+    // is not yet paged in.  System calls page in and unshare the
+    // user memory they use with checkuser() and the fetch functions
+    // before touching it, and fail if they cannot, so a kernel fault
+    // is always a real one.
+    if(myproc() && (tf->cs&3) == DPL_USER){
+      if((tf->err & 2) && cowfault(rcr2()) == 0)
+        break;
+      // A program page that cannot be read must not be
+      // replaced by a heap page of zeros.
+      if(!(tf->err & 1) && ((r = execfault(rcr2())) == 0 ||
+                            (r == -1 && heapfault(rcr2()) == 0)))
+        break;
+      if(mmapfault(rcr2(), tf->err & 2) == 0)
+        break;
+    }
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -0,0 +1,7 @@
+// Scatter/gather I/O vector for readv() and writev().
+struct iovec {
+  void *iov_base;  // start of buffer
+  uint iov_len;    // length of buffer in bytes
+};
+
+#define IOV_MAX 16  // most iovecs in one readv() or writev()
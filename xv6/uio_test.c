@@ -0,0 +1,100 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "uio.h"
+
+#define FILENAME "uio.tmp"
+#define FILESIZE (1024 * 1024)
+#define NIOV 8
+
+char buf[NIOV * 1024];
+struct iovec iov[NIOV];
+
+void fail(char *msg)
+{
+  printf(2, "uio_test: %s\n", msg);
+  exit();
+}
+
+// Print the ticks taken since start, then let the kernel print
+// and reset its syscall counters for the phase just finished.
+void report(char *what, int start)
+{
+  printf(1, "%s: 1 MB in %d ticks, syscalls:\n", what, uptime() - start);
+  print_cpu_syscalls_count();
+}
+
+int main(int argc, char *argv[])
+{
+  int fd, i, n, start;
+
+  for (i = 0; i < NIOV; i++)
+  {
+    iov[i].iov_base = buf + i * 1024;
+    iov[i].iov_len = 1024;
+  }
+  memset(buf, 'x', sizeof(buf));
+  print_cpu_syscalls_count();
+
+  start = uptime();
+  if ((fd = open(FILENAME, O_CREATE | O_RDWR)) < 0)
+    fail("cannot create file");
+  for (i = 0; i < FILESIZE / 512; i++)
+    if (write(fd, buf, 512) != 512)
+      fail("write failed");
+  close(fd);
+  report("write, 512 bytes per call", start);
+
+  start = uptime();
+  if ((fd = open(FILENAME, O_RDWR)) < 0)
+    fail("cannot open file");
+  for (i = 0; i < FILESIZE / sizeof(buf); i++)
+    if (writev(fd, iov, NIOV) != sizeof(buf))
+      fail("writev failed");
+  close(fd);
+  report("writev, 8 KB per call", start);
+
+  start = uptime();
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  while ((n = read(fd, buf, 512)) > 0)
+    ;
+  close(fd);
+  report("read, 512 bytes per call", start);
+
+  start = uptime();
+  if ((fd = open(FILENAME, O_RDONLY)) < 0)
+    fail("cannot open file");
+  while ((n = readv(fd, iov, NIOV)) > 0)
+    ;
+  close(fd);
+  report("readv, 8 KB per call", start);
+
+  // pread and pwrite use their own offset, not the file's.
+  if ((fd = open(FILENAME, O_RDWR)) < 0)
+    fail("cannot open file");
+  if (pwrite(fd, "hello", 5, 4096) != 5)
+    fail("pwrite failed");
+  if (pread(fd, buf, 5, 4096) != 5 || buf[0] != 'h' || buf[4] != 'o')
+    fail("pread did not see pwrite");
+  if (read(fd, buf, 1) != 1 || buf[0] != 'x')
+    fail("pwrite moved the file offset");
+
+  // At and past the end of the file, pread and readv return 0
+  // like read, and a pread across the end is short.
+  if (pread(fd, buf, 5, FILESIZE - 2) != 2)
+    fail("pread across the end is not short");
+  if (pread(fd, buf, 5, FILESIZE) != 0 ||
+      pread(fd, buf, 5, FILESIZE + 4096) != 0)
+    fail("pread past the end did not return 0");
+  while ((n = readv(fd, iov, NIOV)) > 0)
+    ;
+  if (n != 0)
+    fail("readv at the end did not return 0");
+  close(fd);
+  printf(1, "pread/pwrite ok\n");
+
+  unlink(FILENAME);
+  exit();
+}
@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct spawnact;
 
 // system calls
 int fork(void);
@@ -23,6 +25,23 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int lseek(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int msync(void*, uint);
+int sendfile(int, int, int*, int);
+int fcntl(int, int, int);
+int context_switches(void);
+int spawn(char*, char**, struct spawnact*, int);
+int memusage(void);
+int freemem(void);
+char* openshmem(int);
+int closeshmem(int);
+void slabinfo(void);
 int set_bjs_process_parameters(int, float, float, float, float);
 void set_bjf_system_parameters(float, float, float, float);
 void print_process_info_table(void);
@@ -45,9 +64,12 @@ int atoi(const char*);
 // Extra
 int find_digital_root(void);
 int copy_file(const char *src, const char *dest);
+int reflink_file(const char *src, const char *dest);
 int get_uncle_count(int);
 int get_process_lifetime(int);
 void init_prioritylock(void);
 void acquire_prioritylock(void);
 void release_prioritylock(void);
-void print_cpu_syscalls_count(void);
\ No newline at end of file
+void print_cpu_syscalls_count(void);
+int set_io_queue_depth(int);
+int set_readahead(int);
\ No newline at end of file
@@ -184,6 +184,10 @@ writetest(void)
   printf(stdout, "small file test ok\n");
 }
 
+// 512-byte writes in writetest1: a file of MAXFILE blocks, capped
+// at half the file system when blocks are larger than 512 bytes.
+#define BIGWRITES (MAXFILE < FSSIZE*(BSIZE/512)/2 ? MAXFILE : FSSIZE*(BSIZE/512)/2)
+
 void
 writetest1(void)
 {
@@ -197,7 +201,7 @@ writetest1(void)
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGWRITES; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, 512) != 512){
       printf(stdout, "error: write big file failed\n", i);
@@ -217,7 +221,7 @@ writetest1(void)
   for(;;){
     i = read(fd, buf, 512);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n == BIGWRITES - 1){
         printf(stdout, "read only %d blocks from big", n);
         exit();
       }
@@ -354,6 +358,76 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// Resizing a pipe keeps the data in it, then push 1 MB through
+// pipes of several sizes, reporting throughput and context
+// switches per MB.
+void
+pipesizes(void)
+{
+  int fds[2], sizes[3], i, j, n, total, size, sw, t;
+
+  printf(1, "pipe sizes test\n");
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  for(i = 0; i < 100; i++)
+    buf[i] = i;
+  if(write(fds[1], buf, 100) != 100 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 64*1024) != 64*1024 ||
+     fcntl(fds[0], F_GETPIPE_SZ, 0) != 64*1024 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 3*4096) != 4*4096 ||
+     fcntl(fds[1], F_SETPIPE_SZ, 50) < 50 ||
+     read(fds[0], buf, sizeof(buf)) != 100){
+    printf(1, "pipe resize failed\n");
+    exit();
+  }
+  for(i = 0; i < 100; i++){
+    if(buf[i] != i){
+      printf(1, "pipe resize lost data\n");
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  sizes[0] = 0;
+  sizes[1] = 16*1024;
+  sizes[2] = 64*1024;
+  for(j = 0; j < 3; j++){
+    if(pipe(fds) != 0){
+      printf(1, "pipe() failed\n");
+      exit();
+    }
+    if(sizes[j])
+      fcntl(fds[1], F_SETPIPE_SZ, sizes[j]);
+    size = fcntl(fds[1], F_GETPIPE_SZ, 0);
+    sw = context_switches();
+    t = uptime();
+    if(fork() == 0){
+      close(fds[0]);
+      for(i = 0; i < 128; i++)
+        write(fds[1], buf, sizeof(buf));
+      exit();
+    }
+    close(fds[1]);
+    total = 0;
+    while((n = read(fds[0], buf, sizeof(buf))) > 0)
+      total += n;
+    close(fds[0]);
+    wait();
+    t = uptime() - t;
+    sw = context_switches() - sw;
+    if(total != 128*sizeof(buf)){
+      printf(1, "pipe sizes: got %d bytes\n", total);
+      exit();
+    }
+    printf(1, "pipe %d bytes: %d KB/s, %d switches/MB\n",
+           size, t ? 1024*100/t : 0, sw);
+  }
+  printf(1, "pipe sizes ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -1781,6 +1855,7 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipesizes();
   preempt();
   exitwait();
 
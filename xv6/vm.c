@@ -32,7 +32,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -42,10 +42,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kzalloc()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +56,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -101,7 +100,13 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // (directly addressable from end..P2V(PHYSTOP)).
 
 // This table defines the kernel's mappings, which are present in
-// every process's page table.
+// every process's page table.  kvmalloc() builds them once in
+// kpgdir, using 4 MB pages wherever the alignment allows and global
+// entries so that they survive switches between page tables, and
+// setupkvm() copies kpgdir's kernel page directory entries.  The
+// few page tables that cover the rest, at the start of the kernel
+// where the text is mapped read-only, are shared by every page
+// directory and never freed.
 static struct kmap {
   void *virt;
   uint phys_start;
@@ -114,33 +119,61 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Map [va, va+size) to pa in pgdir for the kernel, with a 4 MB
+// page for each aligned 4 MB stretch and 4 KB pages elsewhere.
+static int
+mapkernel(pde_t *pgdir, char *va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  perm |= PTE_G;
+  for(; size > 0; va += n, pa += n, size -= n){
+    if((uint)va % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       size >= SUPERPGSIZE){
+      if(pgdir[PDX(va)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+      n = SUPERPGSIZE;
+    } else {
+      if(mappages(pgdir, va, PGSIZE, pa, perm) < 0)
+        return -1;
+      n = PGSIZE;
+    }
+  }
+  return 0;
+}
+
+// Set up kernel part of a page table.  Only the user half
+// needs clearing, since the kernel half is copied over.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes.  It also serves as the model
+// for the kernel part of every other page table.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  if((kpgdir = (pde_t*)kzalloc()) == 0)
+    panic("kvmalloc");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mapkernel(kpgdir, k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc");
   switchkvm();
 }
 
@@ -186,36 +219,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,13 +239,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -279,20 +286,24 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part, in one pass over the user page tables.
+// The kernel part is shared with kpgdir.
 void
 freevm(pde_t *pgdir)
 {
-  uint i;
+  pte_t *pgtab;
+  uint i, j;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
-      char * v = P2V(PTE_ADDR(pgdir[i]));
-      kfree(v);
-    }
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(!(pgdir[i] & PTE_P))
+      continue;
+    pgtab = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+    for(j = 0; j < NPTENTRIES; j++)
+      if(pgtab[j] & PTE_P)
+        kfree(P2V(PTE_ADDR(pgtab[j])));
+    kfree((char*)pgtab);
   }
   kfree((char*)pgdir);
 }
@@ -311,31 +322,35 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  The pages themselves are not copied:
+// both page tables map them read-only and marked PTE_COW,
+// and cowfault() gives a process its own copy of a page when
+// it first writes it.  The caller must flush the TLB for pgdir.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+    // Heap pages the parent has not touched yet stay
+    // unallocated in the child too.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    kdup(P2V(pa));
   }
   return d;
 
@@ -344,6 +359,103 @@ bad:
   return 0;
 }
 
+// Handle a write fault at va in the current process.  If va is
+// in a copy-on-write page, make the page writable, first copying
+// it if another page table still shares it.  Returns -1 if va is
+// not in such a page or there is no memory for the copy.
+int
+cowfault(uint va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint pa;
+  char *mem;
+
+  if(va >= KERNBASE || (pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  if(krefs(P2V(pa)) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | PTE_FLAGS(*pte);
+    kfree(P2V(pa));
+  }
+  *pte = (*pte | PTE_W) & ~PTE_COW;
+  lcr3(V2P(p->pgdir));
+  return 0;
+}
+
+// Handle a fault on the not-present page holding va in the
+// current process.  Pages below sz that sbrk() has added, or
+// that hold bss, but nobody has touched yet get a zeroed page.  Returns -1 if va
+// is not in such a page or memory is exhausted.
+int
+heapfault(uint va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  char *mem;
+
+  if(va >= p->sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return -1;
+  if((mem = kzalloc()) == 0)
+    return -1;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Make the pages of [va, va+n), which lie below sz, present in
+// the current process, so that a system call can use them while
+// holding a spinlock: paging in program text may sleep.  If write
+// is set, also give the process its own copy of any copy-on-write
+// page, so that running out of memory fails the system call instead
+// of a kernel write.
+int
+uvmpagein(uint va, uint n, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint a;
+  int r;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if((pte == 0 || !(*pte & PTE_P)) &&
+       (r = execfault(a)) != 0 && (r == -2 || heapfault(a) < 0))
+      return -1;
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(write && (*pte & PTE_COW) && cowfault(a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Count the pages of user memory below sz that are present.
+uint
+residentuvm(pde_t *pgdir, uint sz)
+{
+  pte_t *pte;
+  uint a, n;
+
+  n = 0;
+  for(a = 0; a < sz; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(*pte & PTE_P)
+      n++;
+  }
+  return n;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -1,30 +1,58 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "uio.h"
+#include "mman.h"
 
-char buf[512];
+#define NIOV 8
+
+char buf[NIOV*1024];
+struct iovec iov[NIOV];
+int l, w, c, inword;
+
+void
+count(char *p, int n)
+{
+  int i;
+
+  for(i=0; i<n; i++){
+    c++;
+    if(p[i] == '\n')
+      l++;
+    if(strchr(" \r\t\n\v", p[i]))
+      inword = 0;
+    else if(!inword){
+      w++;
+      inword = 1;
+    }
+  }
+}
 
 void
 wc(int fd, char *name)
 {
   int i, n;
-  int l, w, c, inword;
+  struct stat st;
+  char *p;
 
   l = w = c = 0;
   inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
-        l++;
-      if(strchr(" \r\t\n\v", buf[i]))
-        inword = 0;
-      else if(!inword){
-        w++;
-        inword = 1;
-      }
-    }
+
+  // Scan regular files in place rather than copying them out.
+  if(fstat(fd, &st) >= 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+    count(p, st.size);
+    munmap(p, st.size);
+    printf(1, "%d %d %d %s\n", l, w, c, name);
+    return;
+  }
+
+  for(i = 0; i < NIOV; i++){
+    iov[i].iov_base = buf + i*1024;
+    iov[i].iov_len = 1024;
   }
+  while((n = readv(fd, iov, NIOV)) > 0)
+    count(buf, n);
   if(n < 0){
     printf(1, "wc: read error\n");
     exit();